@@ -1,13 +1,21 @@
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <climits>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <mutex>
 #include <string>
 #include <sstream>
 #include <set>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
+#include <unistd.h>
 #include <unordered_map>
 #include <vector>
 #include "sam.h"
@@ -110,7 +118,8 @@ void remove_transcript(const transcript_t transcript_to_remove, gene_annotation_
 	}
 }
 
-bool get_gtf_attribute(const string& attributes, const vector<string>& attribute_names, string& attribute_value) {
+// warnings are collected in <warnings> rather than printed, because lines are parsed by multiple threads
+bool get_gtf_attribute(const string& attributes, const vector<string>& attribute_names, string& attribute_value, string& warnings) {
 
 	// find start of attribute
 	size_t start = string::npos;
@@ -118,30 +127,18 @@ bool get_gtf_attribute(const string& attributes, const vector<string>& attribute
 		start = attributes.find(*attribute_name + " \"");
 	if (start < attributes.size())
 		start = attributes.find('"', start);
-	if (start >= attributes.size()) {
-		cerr << "WARNING: failed to extract ";
-		for (auto attribute_name = attribute_names.begin(); attribute_name != attribute_names.end(); ++attribute_name) {
-			if (attribute_name != attribute_names.begin())
-				cerr << "|";
-			cerr << *attribute_name;
-		}
-		cerr << " from line in GTF file: " << attributes << endl;
-		return false;
-	}
-	start++;
-
-	// find end of attribute
-	size_t end = attributes.find('"', start);
+	size_t end = (start < attributes.size()) ? attributes.find('"', start + 1) : string::npos;
 	if (end >= attributes.size()) {
-		cerr << "WARNING: failed to extract ";
+		warnings += "WARNING: failed to extract ";
 		for (auto attribute_name = attribute_names.begin(); attribute_name != attribute_names.end(); ++attribute_name) {
 			if (attribute_name != attribute_names.begin())
-				cerr << "|";
-			cerr << *attribute_name;
+				warnings += "|";
+			warnings += *attribute_name;
 		}
-		cerr << " from line in GTF file: " << attributes << endl;
+		warnings += " from line in GTF file: " + attributes + "\n";
 		return false;
 	}
+	start++;
 	attribute_value = attributes.substr(start, end - start);
 
 	return true;
@@ -158,7 +155,122 @@ struct coding_region_t {
 	string transcript_id;
 };
 
-void read_annotation_gtf(const string& filename, const string& gtf_features_string, contigs_t& contigs, vector<string>& original_contig_names, const assembly_t& assembly, gene_annotation_t& gene_annotation, transcript_annotation_t& transcript_annotation, exon_annotation_t& exon_annotation, unordered_map<string,gene_t>& gene_names) {
+enum gtf_line_type_t { GTF_LINE_IGNORED, GTF_LINE_OTHER, GTF_LINE_EXON, GTF_LINE_CDS };
+
+// a line of the GTF file, which has been parsed by a worker thread, but which has not yet been added to the annotation
+struct gtf_line_t {
+	gtf_line_type_t type;
+	string contig, gene_name, gene_id, short_gene_id, transcript_id, short_transcript_id;
+	position_t start, end;
+	strand_t strand;
+	string warnings; // printed when the line is added to the annotation to preserve the order of the messages
+};
+
+// the GTF file is split into blocks of complete lines, which are parsed in parallel
+const size_t GTF_BLOCK_SIZE = 1024*1024;
+struct gtf_block_t {
+	gtf_block_t() { parsed = false; };
+	const char* start;
+	const char* end;
+	vector<gtf_line_t> lines;
+	bool parsed; // guarded by gtf_parser_t::progress_mutex
+};
+
+class gtf_parser_t {
+	public:
+		gtf_parser_t(const gtf_features_t& gtf_features, const unsigned int block_count, const unsigned int max_blocks_ahead): gtf_features(gtf_features), blocks(block_count), max_blocks_ahead(max_blocks_ahead) { next_block = 0; merged_blocks = 0; };
+		const gtf_features_t& gtf_features;
+		vector<gtf_block_t> blocks;
+		atomic<unsigned int> next_block; // the worker threads take one block at a time
+		unsigned int merged_blocks; // blocks which have been added to the annotation by the main thread
+		const unsigned int max_blocks_ahead; // limits how many parsed lines are held in memory
+		// the threads sleep rather than spin while waiting for each other, because other threads (e.g., those loading the assembly) need the CPU
+		mutex progress_mutex; // guards <parsed> of the blocks and <merged_blocks>
+		condition_variable block_parsed; // signalled by the worker threads
+		condition_variable blocks_merged; // signalled by the main thread
+};
+
+void parse_gtf_line(const string& line, const gtf_features_t& gtf_features, gtf_line_t& gtf_line) {
+	gtf_line.type = GTF_LINE_IGNORED;
+
+	tsv_stream_t tsv(line);
+	string strand, feature, attributes, trash;
+	tsv >> gtf_line.contig >> trash >> feature >> gtf_line.start >> gtf_line.end >> trash >> strand >> trash >> attributes;
+	if (tsv.fail() || gtf_line.contig.empty() || feature.empty() || strand.empty()) {
+		gtf_line.warnings += "WARNING: failed to parse line in GTF file: " + line + "\n";
+		return;
+	}
+
+	// extract gene name and ID from attributes
+	if (!get_gtf_attribute(attributes, gtf_features.gene_name, gtf_line.gene_name, gtf_line.warnings) ||
+	    !get_gtf_attribute(attributes, gtf_features.gene_id, gtf_line.gene_id, gtf_line.warnings))
+		return;
+	gtf_line.short_gene_id = strip_ensembl_version_number(gtf_line.gene_id);
+
+	gtf_line.start--; // GTF files are one-based
+	gtf_line.end--; // GTF files are one-based
+	gtf_line.strand = (strand[0] == '+') ? FORWARD : REVERSE;
+	gtf_line.type = GTF_LINE_OTHER; // the contig is registered, even if the feature is not used
+
+	// extract transcript ID from attributes
+	if (find(gtf_features.feature_exon.begin(), gtf_features.feature_exon.end(), feature) != gtf_features.feature_exon.end()) {
+		if (!get_gtf_attribute(attributes, gtf_features.transcript_id, gtf_line.transcript_id, gtf_line.warnings))
+			return;
+		gtf_line.short_transcript_id = strip_ensembl_version_number(gtf_line.transcript_id);
+		gtf_line.type = GTF_LINE_EXON;
+	} else if (find(gtf_features.feature_cds.begin(), gtf_features.feature_cds.end(), feature) != gtf_features.feature_cds.end()) {
+		if (!get_gtf_attribute(attributes, gtf_features.transcript_id, gtf_line.transcript_id, gtf_line.warnings))
+			return;
+		gtf_line.type = GTF_LINE_CDS;
+	}
+}
+
+// worker thread which parses the lines of one block at a time
+void parse_gtf_blocks(gtf_parser_t* gtf_parser) {
+	string line;
+	for (unsigned int block = gtf_parser->next_block++; block < gtf_parser->blocks.size(); block = gtf_parser->next_block++) {
+
+		// do not run too far ahead of the main thread, which consumes the parsed lines
+		{
+			unique_lock<mutex> lock(gtf_parser->progress_mutex);
+			while (block >= gtf_parser->merged_blocks + gtf_parser->max_blocks_ahead)
+				gtf_parser->blocks_merged.wait(lock);
+		}
+
+		gtf_block_t& gtf_block = gtf_parser->blocks[block];
+		for (const char* line_start = gtf_block.start; line_start < gtf_block.end;) {
+			const char* line_end = (const char*) memchr(line_start, '\n', gtf_block.end - line_start);
+			if (line_end == NULL)
+				line_end = gtf_block.end; // last line of file lacks a line break
+			line.assign(line_start, line_end);
+			line_start = line_end + 1;
+
+			// remove carriage return in case of DOS line breaks
+			if (!line.empty() && line[line.size()-1] == '\r')
+				line.resize(line.size()-1);
+
+			if (!line.empty() && line[0] != '#') { // skip comment lines
+				gtf_block.lines.resize(gtf_block.lines.size() + 1);
+				parse_gtf_line(line, gtf_parser->gtf_features, gtf_block.lines.back());
+			}
+		}
+		{
+			lock_guard<mutex> lock(gtf_parser->progress_mutex);
+			gtf_block.parsed = true;
+		}
+		gtf_parser->block_parsed.notify_one(); // only the main thread waits for this
+	}
+}
+
+// make a map of gene_name -> gene
+//TODO this can cause collisions, because gene names are not unique
+void make_gene_name_map(gene_annotation_t& gene_annotation, unordered_map<string,gene_t>& gene_names) {
+	gene_names.clear();
+	for (gene_annotation_t::iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene)
+		gene_names[gene->name] = &(*gene);
+}
+
+void read_annotation_gtf(const string& filename, const string& gtf_features_string, contigs_t& contigs, vector<string>& original_contig_names, vector<contig_t>& gtf_contigs, gene_annotation_t& gene_annotation, transcript_annotation_t& transcript_annotation, exon_annotation_t& exon_annotation, unordered_map<string,gene_t>& gene_names, const unsigned int threads) {
 
 	gtf_features_t gtf_features;
 	parse_gtf_features(gtf_features_string, gtf_features);
@@ -174,44 +286,67 @@ void read_annotation_gtf(const string& filename, const string& gtf_features_stri
 	gene_set_t malformed_genes;
 	vector< tuple<string,contig_t,strand_t> > malformed_transcripts;
 
-	autodecompress_file_t gtf_file(filename);
-	string line;
+	// split the file into blocks of complete lines
+	file_content_t gtf_file(filename);
+	vector<const char*> block_starts;
+	for (const char* block_start = gtf_file.data(); block_start < gtf_file.data() + gtf_file.size();) {
+		block_starts.push_back(block_start);
+		block_start += min(GTF_BLOCK_SIZE, (size_t) (gtf_file.data() + gtf_file.size() - block_start));
+		const char* line_end = (const char*) memchr(block_start, '\n', gtf_file.data() + gtf_file.size() - block_start);
+		block_start = (line_end == NULL) ? gtf_file.data() + gtf_file.size() : line_end + 1;
+	}
+
+	// the lines are parsed by worker threads, but they are added to the annotation in the order of the file,
+	// such that the IDs of genes and transcripts do not depend on the number of threads
+	gtf_parser_t gtf_parser(gtf_features, block_starts.size(), 4 * max(threads, 1U));
+	for (unsigned int block = 0; block < block_starts.size(); ++block) {
+		gtf_parser.blocks[block].start = block_starts[block];
+		gtf_parser.blocks[block].end = (block + 1 < block_starts.size()) ? block_starts[block+1] : gtf_file.data() + gtf_file.size();
+	}
+	vector<thread> workers;
+	for (unsigned int worker = 0; worker < max(threads, 1U) && worker < gtf_parser.blocks.size(); ++worker)
+		workers.push_back(std::thread(parse_gtf_blocks, &gtf_parser));
+
 	set<string> non_unique_items;
 	unsigned int new_id = 0; // ID generator for genes and transcripts
-	while (gtf_file.getline(line)) {
-		if (!line.empty() && line[0] != '#') { // skip comment lines
-
-			tsv_stream_t tsv(line);
-			annotation_record_t annotation_record;
-			string contig, strand, feature, attributes, trash, gene_name, gene_id;
+	vector<bool> is_gtf_contig; // contigs which have been added to <gtf_contigs> already
+	for (unsigned int block = 0; block < gtf_parser.blocks.size(); ++block) {
+
+		// wait for the worker threads to parse the block
+		{
+			unique_lock<mutex> lock(gtf_parser.progress_mutex);
+			while (!gtf_parser.blocks[block].parsed)
+				gtf_parser.block_parsed.wait(lock);
+		}
 
-			// parse line
-			tsv >> contig >> trash >> feature >> annotation_record.start >> annotation_record.end >> trash >> strand >> trash >> attributes;
-			if (tsv.fail() || contig.empty() || feature.empty() || strand.empty()) {
-				cerr << "WARNING: failed to parse line in GTF file: " << line << endl;
-				continue;
-			}
+		vector<gtf_line_t>& lines = gtf_parser.blocks[block].lines;
+		for (vector<gtf_line_t>::iterator line = lines.begin(); line != lines.end(); ++line) {
 
-			// extract gene name and ID from attributes
-			if (!get_gtf_attribute(attributes, gtf_features.gene_name, gene_name) ||
-			    !get_gtf_attribute(attributes, gtf_features.gene_id, gene_id))
+			cerr << line->warnings;
+			if (line->type == GTF_LINE_IGNORED)
 				continue;
-			string short_gene_id = strip_ensembl_version_number(gene_id);
 
 			// convert string representation of contig to numeric ID
-			pair<contigs_t::iterator,bool> find_contig_by_name = contigs.insert(pair<string,contig_t>(removeChr(contig), contigs.size())); // this adds a new contig only if it does not yet exist
+			pair<contigs_t::iterator,bool> find_contig_by_name = contigs.insert(pair<string,contig_t>(removeChr(line->contig), contigs.size())); // this adds a new contig only if it does not yet exist
 			crash(contigs.size() == USHRT_MAX - 1, "too many contigs");
 			if (original_contig_names.size() < contigs.size())
 				original_contig_names.resize(contigs.size());
-			original_contig_names[find_contig_by_name.first->second] = contig;
+			original_contig_names[find_contig_by_name.first->second] = line->contig;
+			if (is_gtf_contig.size() < contigs.size())
+				is_gtf_contig.resize(contigs.size());
+			if (!is_gtf_contig[find_contig_by_name.first->second]) {
+				is_gtf_contig[find_contig_by_name.first->second] = true;
+				gtf_contigs.push_back(find_contig_by_name.first->second);
+			}
 
 			// make annotation record
+			annotation_record_t annotation_record;
 			annotation_record.contig = find_contig_by_name.first->second;
-			annotation_record.start--; // GTF files are one-based
-			annotation_record.end--; // GTF files are one-based
-			annotation_record.strand = (strand[0] == '+') ? FORWARD : REVERSE;
+			annotation_record.start = line->start;
+			annotation_record.end = line->end;
+			annotation_record.strand = line->strand;
 
-			if (find(gtf_features.feature_exon.begin(), gtf_features.feature_exon.end(), feature) != gtf_features.feature_exon.end()) {
+			if (line->type == GTF_LINE_EXON) {
 
 				// make exon annotation record
 				exon_annotation_record_t exon_annotation_record;
@@ -219,38 +354,32 @@ void read_annotation_gtf(const string& filename, const string& gtf_features_stri
 				exon_annotation_record.coding_region_start = -1;
 				exon_annotation_record.coding_region_end = -1;
 
-				// extract transcript ID from attributes
-				string transcript_id;
-				if (!get_gtf_attribute(attributes, gtf_features.transcript_id, transcript_id))
-					continue;
-				string short_transcript_id = strip_ensembl_version_number(transcript_id);
-
 				// make transcript annotation record
-				transcript_t& transcript = transcripts[make_tuple(short_transcript_id, annotation_record.contig, annotation_record.strand)];
+				transcript_t& transcript = transcripts[make_tuple(line->short_transcript_id, annotation_record.contig, annotation_record.strand)];
 				if (transcript == NULL) { // this is the first time we encounter this transcript ID => make a new transcript_annotation_record_t
 					transcript_annotation_record_t transcript_annotation_record;
 					transcript_annotation_record.id = new_id++;
-					transcript_annotation_record.name = transcript_id;
+					transcript_annotation_record.name = transcript_annotation.strings.add(line->transcript_id);
 					transcript_annotation_record.first_exon = NULL; // is set once we have loaded all exons
 					transcript_annotation_record.last_exon = NULL; // is set once we have loaded all exons
 					transcript_annotation.push_back(transcript_annotation_record);
-					transcript = &(*transcript_annotation.rbegin());
+					transcript = &transcript_annotation.back();
 				}
 				exon_annotation_record.transcript = transcript;
 
 				// make a gene annotation record, if this is the first exon of a gene
-				gene_t& gene = gene_by_id[make_tuple(short_gene_id, annotation_record.contig, annotation_record.strand)];
+				gene_t& gene = gene_by_id[make_tuple(line->short_gene_id, annotation_record.contig, annotation_record.strand)];
 				if (gene == NULL) {
 					gene_annotation_record_t gene_annotation_record;
 					gene_annotation_record.copy(annotation_record);
 					gene_annotation_record.id = new_id++;
-					gene_annotation_record.gene_id = gene_id;
-					gene_annotation_record.name = gene_name;
+					gene_annotation_record.gene_id = gene_annotation.strings.add(line->gene_id);
+					gene_annotation_record.name = gene_annotation.strings.add(line->gene_name);
 					gene_annotation_record.exonic_length = 0; // is calculated later in arriba.cpp
 					gene_annotation_record.is_dummy = false;
 					gene_annotation_record.is_protein_coding = false;
 					gene_annotation.push_back(gene_annotation_record);
-					gene = &(*gene_annotation.rbegin());
+					gene = &gene_annotation.back();
 				} else { // gene has already been seen previously
 					// expand the boundaries of the gene, so that all exons fit inside
 					if (gene->start > exon_annotation_record.start)
@@ -259,28 +388,21 @@ void read_annotation_gtf(const string& filename, const string& gtf_features_stri
 						gene->end = exon_annotation_record.end;
 					// check if annotation is sensible
 					if (gene->contig != annotation_record.contig || gene->end - gene->start > max_gene_size) {
-						if (non_unique_items.find(gene_id) == non_unique_items.end()) {
-							cerr << "WARNING: gene ID '" << gene_id << "' appears to be non-unique and will be ignored" << endl;
-							non_unique_items.insert(gene_id); // report gene only once
+						if (non_unique_items.find(line->gene_id) == non_unique_items.end()) {
+							cerr << "WARNING: gene ID '" << line->gene_id << "' appears to be non-unique and will be ignored" << endl;
+							non_unique_items.insert(line->gene_id); // report gene only once
 						}
 						malformed_genes.insert(gene);
 					}
 				}
-				if (assembly.find(gene->contig) != assembly.end() && (unsigned int) gene->end >= assembly.at(gene->contig).size()) {
-					if (non_unique_items.find(gene_id) == non_unique_items.end()) {
-						cerr << "WARNING: gene with ID '" << gene_id << "' extends beyond end of contig and will be ignored" << endl;
-						non_unique_items.insert(gene_id); // report gene only once
-					}
-					malformed_genes.insert(gene);
-				}
 
 				exon_annotation_record.gene = gene;
 				exon_annotation.push_back(exon_annotation_record);
 
 				// keep track of all exons of a transcript, so we can map coding regions to exons later
-				exons_by_transcript_id[make_tuple(transcript_id, annotation_record.contig, annotation_record.strand)].push_back(&(*exon_annotation.rbegin()));
+				exons_by_transcript_id[make_tuple(line->transcript_id, annotation_record.contig, annotation_record.strand)].push_back(&exon_annotation.back());
 
-			} else if (find(gtf_features.feature_cds.begin(), gtf_features.feature_cds.end(), feature) != gtf_features.feature_cds.end()) {
+			} else if (line->type == GTF_LINE_CDS) {
 
 				// remember which regions of an exon are coding
 				coding_region_t coding_region;
@@ -288,13 +410,23 @@ void read_annotation_gtf(const string& filename, const string& gtf_features_stri
 				coding_region.contig = annotation_record.contig;
 				coding_region.start = annotation_record.start;
 				coding_region.end = annotation_record.end;
-				if (!get_gtf_attribute(attributes, gtf_features.transcript_id, coding_region.transcript_id))
-					continue;
+				coding_region.transcript_id = line->transcript_id;
 				coding_regions.push_back(coding_region);
 			}
 		}
+
+		// free the memory of the block and let the worker threads continue
+		vector<gtf_line_t>().swap(lines);
+		{
+			lock_guard<mutex> lock(gtf_parser.progress_mutex);
+			gtf_parser.merged_blocks++;
+		}
+		gtf_parser.blocks_merged.notify_all();
 	}
 
+	for (vector<thread>::iterator worker = workers.begin(); worker != workers.end(); ++worker)
+		worker->join();
+
 	crash(gene_annotation.empty(), "failed to parse GTF file, please consider using -G");
 
 	// map coding regions to exons
@@ -363,69 +495,431 @@ void read_annotation_gtf(const string& filename, const string& gtf_features_stri
 	for (gene_set_t::iterator malformed_gene = malformed_genes.begin(); malformed_gene != malformed_genes.end(); ++malformed_gene)
 		remove_gene(*malformed_gene, gene_annotation, exon_annotation);
 
-	// make a map of gene_name -> gene
-	//TODO this can cause collisions, because gene names are not unique
-	for (gene_annotation_t::iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene)
-		gene_names[gene->name] = &(*gene);
+	make_gene_name_map(gene_annotation, gene_names);
+}
+
+bool remove_genes_beyond_contig_ends(const assembly_t& assembly, gene_annotation_t& gene_annotation, exon_annotation_t& exon_annotation, unordered_map<string,gene_t>& gene_names) {
 
+	gene_set_t genes_beyond_contig_ends;
+	for (gene_annotation_t::iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene) {
+		assembly_t::const_iterator contig_sequence = assembly.find(gene->contig);
+		if (contig_sequence != assembly.end() && (unsigned int) gene->end >= contig_sequence->second.size()) {
+			cerr << "WARNING: gene with ID '" << gene->gene_id << "' extends beyond end of contig and will be ignored" << endl;
+			genes_beyond_contig_ends.insert(&(*gene));
+		}
+	}
+
+	if (genes_beyond_contig_ends.empty())
+		return false;
+	for (gene_set_t::iterator gene = genes_beyond_contig_ends.begin(); gene != genes_beyond_contig_ends.end(); ++gene)
+		remove_gene(*gene, gene_annotation, exon_annotation);
+	make_gene_name_map(gene_annotation, gene_names);
+	return true;
 }
 
-bool filter_exons_near_splice_site(const gene_t gene, const direction_t direction, const position_t breakpoint, const exon_set_t& exons_near_splice_site) {
-	// return only exons which
-	// - belong to given gene
-	// - have a boundary within MAX_SPLICE_SITE_DISTANCE from the breakpoint
-	// - are not the first/last exon in a transcript
-	// - unless:
-	//   - the transcript has only one exon
-	//   - the gene misses a start/stop codon (=> indicates incomplete annotation)
-	for (exon_set_t::const_iterator exon = exons_near_splice_site.begin(); exon != exons_near_splice_site.end(); ++exon)
-		if ((**exon).gene == gene)
-			if (direction == UPSTREAM &&
-			    abs((**exon).start - breakpoint) <= MAX_SPLICE_SITE_DISTANCE &&
-			    ((**exon).previous_exon != NULL || // exon is not a terminal one
-			     (**exon).previous_exon == NULL && (**exon).next_exon == NULL && (**exon).coding_region_start != -1 || // unless transcript has only one exon
-			     (**exon).start == (**exon).coding_region_start) || // or unless the first base of the exon is coding (=> gene is not annotated properly and misses preceeding exons (see TCR genes))
-			    direction == DOWNSTREAM &&
-			    abs((**exon).end - breakpoint) <= MAX_SPLICE_SITE_DISTANCE &&
-			    ((**exon).next_exon != NULL || // exon is not a terminal one
-			     (**exon).previous_exon == NULL && (**exon).next_exon == NULL && (**exon).coding_region_start != -1 || // unless transcript has only one exon
-			     (**exon).end == (**exon).coding_region_end)) // or unless the last base of the exon is coding (=> gene is not annotated properly and misses following exons (see TCR genes))
-				return true;
-	return false;
+// the annotation cache holds the parsed annotation and the indices, such that the GTF file need not be parsed again
+// pointers between records are stored as the positions of the records in their lists
+const char ANNOTATION_CACHE_MAGIC[8] = { 'A', 'R', 'B', 'A', 'G', 'T', 'F', '2' };
+const uint32_t NO_CACHED_RECORD = UINT32_MAX;
+
+class annotation_cache_writer_t: public string {
+	public:
+		template <class T> void write(const T value) { this->append((const char*) &value, sizeof(T)); };
+		void write_string(const string& value) { write<uint32_t>(value.size()); this->append(value); };
+};
+
+// a truncated or malformed cache (e.g., from an interrupted run) is not an error, it is merely regenerated
+// => the reader throws out_of_range, which is also thrown by vector::at() for invalid record IDs
+class annotation_cache_reader_t {
+	public:
+		annotation_cache_reader_t(const string& data): data(data), position(0) {};
+		template <class T> T read() {
+			if (position + sizeof(T) > data.size())
+				throw out_of_range("annotation_cache_reader_t::read");
+			T value;
+			memcpy(&value, data.data() + position, sizeof(T));
+			position += sizeof(T);
+			return value;
+		};
+		string read_string() {
+			uint32_t length = read<uint32_t>();
+			if (position + length > data.size())
+				throw out_of_range("annotation_cache_reader_t::read_string");
+			position += length;
+			return data.substr(position - length, length);
+		};
+		// read the number of items which follow, each of which takes at least <min_item_size> bytes,
+		// such that a corrupt count does not make us allocate huge amounts of memory
+		uint32_t read_count(const size_t min_item_size) {
+			uint32_t count = read<uint32_t>();
+			if ((uint64_t) count * min_item_size > data.size() - position)
+				throw out_of_range("annotation_cache_reader_t::read_count");
+			return count;
+		};
+		bool at_end() const { return position == data.size(); };
+	private:
+		const string& data;
+		size_t position;
+};
+
+template <class T> uint32_t get_cached_record_id(const unordered_map<T,uint32_t>& record_ids, const T record) {
+	typename unordered_map<T,uint32_t>::const_iterator record_id = record_ids.find(record);
+	return (record_id != record_ids.end()) ? record_id->second : NO_CACHED_RECORD;
 }
 
-// check if a breakpoint is near an annotated splice site
-bool is_breakpoint_spliced(const gene_t gene, const direction_t direction, const position_t breakpoint, const exon_annotation_index_t& exon_annotation_index) {
+template <class T> void write_cached_index(annotation_cache_writer_t& cache, const annotation_index_t<T>& annotation_index, const vector<contig_t>& cached_contigs, const unordered_map<T,uint32_t>& record_ids) {
+	for (vector<contig_t>::const_iterator contig = cached_contigs.begin(); contig != cached_contigs.end(); ++contig) {
+		if (*contig >= annotation_index.size()) {
+			cache.write<uint32_t>(0);
+			continue;
+		}
+		cache.write<uint32_t>(annotation_index[*contig].size());
+		for (typename contig_annotation_index_t<T>::const_iterator annotation_set = annotation_index[*contig].begin(); annotation_set != annotation_index[*contig].end(); ++annotation_set) {
+			cache.write<int32_t>(annotation_set->first);
+			cache.write<uint32_t>(annotation_set->second.size());
+			for (typename annotation_span_t<T>::const_iterator record = annotation_set->second.begin(); record != annotation_set->second.end(); ++record)
+				cache.write<uint32_t>(record_ids.at(*record));
+		}
+	}
+}
+
+template <class T> void read_cached_index(annotation_cache_reader_t& cache, annotation_index_t<T>& annotation_index, const vector<contig_t>& contig_ids, const vector<T>& records) {
+	for (vector<contig_t>::const_iterator contig = contig_ids.begin(); contig != contig_ids.end(); ++contig) {
+		vector<position_t> boundaries(cache.read_count(2 * sizeof(uint32_t)));
+		vector<unsigned int> offsets(1, 0);
+		vector<T> pool;
+		for (vector<position_t>::iterator boundary = boundaries.begin(); boundary != boundaries.end(); ++boundary) {
+			*boundary = cache.read<int32_t>();
+			for (uint32_t record_count = cache.read_count(sizeof(uint32_t)); record_count > 0; --record_count)
+				pool.push_back(records.at(cache.read<uint32_t>()));
+			sort(pool.begin() + offsets.back(), pool.end()); // sets are sorted by address, which differs from when the cache was written
+			offsets.push_back(pool.size());
+		}
+		annotation_index[*contig].assign(boundaries, offsets, pool);
+	}
+}
+
+uint64_t get_annotation_cache_key(const string& gtf_file_path, const string& gtf_features) {
+
+	// FNV-1a hash of the content of the GTF file and the GTF features
+	uint64_t hash = 14695981039346656037ULL;
+	FILE* gtf_file = fopen(gtf_file_path.c_str(), "rb");
+	crash(gtf_file == NULL, "failed to open file: " + gtf_file_path);
+	vector<unsigned char> buffer(1024*1024);
+	size_t bytes_read;
+	while ((bytes_read = fread(&buffer[0], 1, buffer.size(), gtf_file)) > 0)
+		for (size_t i = 0; i < bytes_read; ++i)
+			hash = (hash ^ buffer[i]) * 1099511628211ULL;
+	crash(ferror(gtf_file), "failed to read file: " + gtf_file_path);
+	fclose(gtf_file);
+	for (string::const_iterator i = gtf_features.begin(); i != gtf_features.end(); ++i)
+		hash = (hash ^ (unsigned char) *i) * 1099511628211ULL;
+
+	return hash;
+}
+
+void write_annotation_cache(const string& cache_file_path, const uint64_t cache_key, const vector<string>& original_contig_names, const vector<contig_t>& gtf_contigs, const gene_annotation_t& gene_annotation, const transcript_annotation_t& transcript_annotation, const exon_annotation_t& exon_annotation, const exon_annotation_index_t& exon_annotation_index, const gene_annotation_index_t& gene_annotation_index) {
+
+	// number the records, so that pointers can be stored as IDs
+	unordered_map<gene_t,uint32_t> gene_ids;
+	for (gene_annotation_t::const_iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene)
+		gene_ids.insert(make_pair(const_cast<gene_t>(&(*gene)), gene_ids.size()));
+	unordered_map<transcript_t,uint32_t> transcript_ids;
+	for (transcript_annotation_t::const_iterator transcript = transcript_annotation.begin(); transcript != transcript_annotation.end(); ++transcript)
+		transcript_ids.insert(make_pair(const_cast<transcript_t>(&(*transcript)), transcript_ids.size()));
+	unordered_map<exon_t,uint32_t> exon_ids;
+	for (exon_annotation_t::const_iterator exon = exon_annotation.begin(); exon != exon_annotation.end(); ++exon)
+		exon_ids.insert(make_pair(const_cast<exon_t>(&(*exon)), exon_ids.size()));
+
+	// all contigs named in the GTF file are stored in the order in which they were registered, such that loading the cache
+	// assigns the same contig IDs as parsing the GTF file (other contigs are not stored, since the cache must not depend on the assembly)
+	const vector<contig_t>& cached_contigs = gtf_contigs;
+	unordered_map<contig_t,uint32_t> cached_contig_ids;
+	for (vector<contig_t>::const_iterator contig = cached_contigs.begin(); contig != cached_contigs.end(); ++contig)
+		cached_contig_ids.insert(make_pair(*contig, cached_contig_ids.size()));
+
+	annotation_cache_writer_t cache;
+	cache.append(ANNOTATION_CACHE_MAGIC, sizeof(ANNOTATION_CACHE_MAGIC));
+	cache.write<uint64_t>(cache_key);
+
+	cache.write<uint32_t>(cached_contigs.size());
+	for (vector<contig_t>::const_iterator contig = cached_contigs.begin(); contig != cached_contigs.end(); ++contig)
+		cache.write_string(original_contig_names[*contig]);
+
+	cache.write<uint32_t>(gene_annotation.size());
+	for (gene_annotation_t::const_iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene) {
+		cache.write<uint32_t>(cached_contig_ids.at(gene->contig));
+		cache.write<int32_t>(gene->start);
+		cache.write<int32_t>(gene->end);
+		cache.write<uint8_t>(gene->strand);
+		cache.write<uint32_t>(gene->id);
+		cache.write_string(gene->gene_id);
+		cache.write_string(gene->name);
+		cache.write<int32_t>(gene->exonic_length);
+		cache.write<uint8_t>(gene->is_dummy);
+		cache.write<uint8_t>(gene->is_protein_coding);
+	}
+
+	cache.write<uint32_t>(transcript_annotation.size());
+	for (transcript_annotation_t::const_iterator transcript = transcript_annotation.begin(); transcript != transcript_annotation.end(); ++transcript) {
+		cache.write<uint32_t>(transcript->id);
+		cache.write_string(transcript->name);
+		// transcripts of removed genes may point to removed exons, but they are not referenced by any exon anyway
+		cache.write<uint32_t>(get_cached_record_id(exon_ids, transcript->first_exon));
+		cache.write<uint32_t>(get_cached_record_id(exon_ids, transcript->last_exon));
+	}
+
+	cache.write<uint32_t>(exon_annotation.size());
+	for (exon_annotation_t::const_iterator exon = exon_annotation.begin(); exon != exon_annotation.end(); ++exon) {
+		cache.write<uint32_t>(cached_contig_ids.at(exon->contig));
+		cache.write<int32_t>(exon->start);
+		cache.write<int32_t>(exon->end);
+		cache.write<uint8_t>(exon->strand);
+		cache.write<uint32_t>(gene_ids.at(exon->gene));
+		cache.write<uint32_t>(transcript_ids.at(exon->transcript));
+		cache.write<uint32_t>(get_cached_record_id(exon_ids, exon->previous_exon));
+		cache.write<uint32_t>(get_cached_record_id(exon_ids, exon->next_exon));
+		cache.write<int32_t>(exon->coding_region_start);
+		cache.write<int32_t>(exon->coding_region_end);
+	}
+
+	write_cached_index(cache, exon_annotation_index, cached_contigs, exon_ids);
+	write_cached_index(cache, gene_annotation_index, cached_contigs, gene_ids);
+
+	// write to a temporary file and move it into place, such that an interrupted run does not leave a truncated cache behind
+	string temp_file_path = cache_file_path + "." + to_string(getpid()) + ".tmp";
+	FILE* cache_file = fopen(temp_file_path.c_str(), "wb");
+	crash(cache_file == NULL, "failed to open file: " + temp_file_path);
+	bool success = fwrite(cache.data(), 1, cache.size(), cache_file) == cache.size();
+	success = fclose(cache_file) == 0 && success;
+	if (!success)
+		remove(temp_file_path.c_str());
+	crash(!success, "failed to write file: " + temp_file_path);
+	if (rename(temp_file_path.c_str(), cache_file_path.c_str()) != 0) {
+		remove(temp_file_path.c_str());
+		crash(true, "failed to write file: " + cache_file_path);
+	}
+}
+
+void read_annotation_cache(annotation_cache_reader_t& cache, contigs_t& contigs, vector<string>& original_contig_names, gene_annotation_t& gene_annotation, transcript_annotation_t& transcript_annotation, exon_annotation_t& exon_annotation, exon_annotation_index_t& exon_annotation_index, gene_annotation_index_t& gene_annotation_index) {
+
+	// register contigs in the same order as when the GTF file was parsed
+	vector<contig_t> contig_ids(cache.read_count(sizeof(uint32_t)));
+	for (vector<contig_t>::iterator contig = contig_ids.begin(); contig != contig_ids.end(); ++contig) {
+		string contig_name = cache.read_string();
+		pair<contigs_t::iterator,bool> find_contig_by_name = contigs.insert(pair<string,contig_t>(removeChr(contig_name), contigs.size()));
+		crash(contigs.size() == USHRT_MAX - 1, "too many contigs");
+		if (original_contig_names.size() < contigs.size())
+			original_contig_names.resize(contigs.size());
+		original_contig_names[find_contig_by_name.first->second] = contig_name;
+		*contig = find_contig_by_name.first->second;
+	}
+
+	vector<gene_t> genes(cache.read_count(6 * sizeof(uint32_t)));
+	for (vector<gene_t>::iterator gene = genes.begin(); gene != genes.end(); ++gene) {
+		gene_annotation_record_t gene_annotation_record;
+		gene_annotation_record.contig = contig_ids.at(cache.read<uint32_t>());
+		gene_annotation_record.start = cache.read<int32_t>();
+		gene_annotation_record.end = cache.read<int32_t>();
+		gene_annotation_record.strand = cache.read<uint8_t>();
+		gene_annotation_record.id = cache.read<uint32_t>();
+		gene_annotation_record.gene_id = gene_annotation.strings.add(cache.read_string());
+		gene_annotation_record.name = gene_annotation.strings.add(cache.read_string());
+		gene_annotation_record.exonic_length = cache.read<int32_t>();
+		gene_annotation_record.is_dummy = cache.read<uint8_t>();
+		gene_annotation_record.is_protein_coding = cache.read<uint8_t>();
+		gene_annotation.push_back(gene_annotation_record);
+		*gene = &gene_annotation.back();
+	}
+
+	// pointers to exons are resolved once all exons have been loaded
+	vector<transcript_t> transcripts(cache.read_count(4 * sizeof(uint32_t)));
+	vector< pair<uint32_t,uint32_t> > transcript_boundaries(transcripts.size());
+	for (size_t transcript = 0; transcript < transcripts.size(); ++transcript) {
+		transcript_annotation_record_t transcript_annotation_record;
+		transcript_annotation_record.id = cache.read<uint32_t>();
+		transcript_annotation_record.name = transcript_annotation.strings.add(cache.read_string());
+		transcript_boundaries[transcript].first = cache.read<uint32_t>();
+		transcript_boundaries[transcript].second = cache.read<uint32_t>();
+		transcript_annotation.push_back(transcript_annotation_record);
+		transcripts[transcript] = &transcript_annotation.back();
+	}
+
+	vector<exon_t> exons(cache.read_count(9 * sizeof(uint32_t)));
+	vector< pair<uint32_t,uint32_t> > exon_neighbors(exons.size());
+	for (size_t exon = 0; exon < exons.size(); ++exon) {
+		exon_annotation_record_t exon_annotation_record;
+		exon_annotation_record.contig = contig_ids.at(cache.read<uint32_t>());
+		exon_annotation_record.start = cache.read<int32_t>();
+		exon_annotation_record.end = cache.read<int32_t>();
+		exon_annotation_record.strand = cache.read<uint8_t>();
+		exon_annotation_record.gene = genes.at(cache.read<uint32_t>());
+		exon_annotation_record.transcript = transcripts.at(cache.read<uint32_t>());
+		exon_neighbors[exon].first = cache.read<uint32_t>();
+		exon_neighbors[exon].second = cache.read<uint32_t>();
+		exon_annotation_record.coding_region_start = cache.read<int32_t>();
+		exon_annotation_record.coding_region_end = cache.read<int32_t>();
+		exon_annotation.push_back(exon_annotation_record);
+		exons[exon] = &exon_annotation.back();
+	}
+	for (size_t exon = 0; exon < exons.size(); ++exon) {
+		exons[exon]->previous_exon = (exon_neighbors[exon].first == NO_CACHED_RECORD) ? NULL : exons.at(exon_neighbors[exon].first);
+		exons[exon]->next_exon = (exon_neighbors[exon].second == NO_CACHED_RECORD) ? NULL : exons.at(exon_neighbors[exon].second);
+	}
+	for (size_t transcript = 0; transcript < transcripts.size(); ++transcript) {
+		transcripts[transcript]->first_exon = (transcript_boundaries[transcript].first == NO_CACHED_RECORD) ? NULL : exons.at(transcript_boundaries[transcript].first);
+		transcripts[transcript]->last_exon = (transcript_boundaries[transcript].second == NO_CACHED_RECORD) ? NULL : exons.at(transcript_boundaries[transcript].second);
+	}
+
+	exon_annotation_index.resize(contigs.size());
+	read_cached_index(cache, exon_annotation_index, contig_ids, exons);
+	gene_annotation_index.resize(contigs.size());
+	read_cached_index(cache, gene_annotation_index, contig_ids, genes);
 
-	// nothing to do, if there are no exons on the given contig
-	if ((unsigned int) gene->contig >= exon_annotation_index.size() || exon_annotation_index[gene->contig].empty())
+	if (!cache.at_end())
+		throw out_of_range("read_annotation_cache");
+}
+
+bool load_annotation_cache(const string& cache_file_path, const uint64_t cache_key, contigs_t& contigs, vector<string>& original_contig_names, gene_annotation_t& gene_annotation, transcript_annotation_t& transcript_annotation, exon_annotation_t& exon_annotation, unordered_map<string,gene_t>& gene_names, exon_annotation_index_t& exon_annotation_index, gene_annotation_index_t& gene_annotation_index) {
+
+	// load the complete file with a single read
+	FILE* cache_file = fopen(cache_file_path.c_str(), "rb");
+	if (cache_file == NULL)
+		return false; // the cache has not been made yet
+	string data;
+	crash(fseek(cache_file, 0, SEEK_END) != 0, "failed to read file: " + cache_file_path);
+	data.resize(ftell(cache_file));
+	crash(fseek(cache_file, 0, SEEK_SET) != 0, "failed to read file: " + cache_file_path);
+	crash(fread(&data[0], 1, data.size(), cache_file) != data.size(), "failed to read file: " + cache_file_path);
+	fclose(cache_file);
+
+	// the cache is outdated, if it was made from a different GTF file
+	if (data.compare(0, sizeof(ANNOTATION_CACHE_MAGIC), ANNOTATION_CACHE_MAGIC, sizeof(ANNOTATION_CACHE_MAGIC)) != 0 ||
+	    data.size() < sizeof(ANNOTATION_CACHE_MAGIC) + sizeof(uint64_t)) {
+		cerr << "WARNING: not an annotation cache, it will be regenerated: " << cache_file_path << endl;
+		return false;
+	}
+	annotation_cache_reader_t cache(data);
+	for (unsigned int i = 0; i < sizeof(ANNOTATION_CACHE_MAGIC); ++i)
+		cache.read<char>();
+	if (cache.read<uint64_t>() != cache_key)
 		return false;
 
-	// find exons in the vicinity of the breakpoint
-	exon_contig_annotation_index_t::const_iterator exons_at_breakpoint = exon_annotation_index[gene->contig].lower_bound(breakpoint);
-	if (exons_at_breakpoint != exon_annotation_index[gene->contig].end()) {
-		if (filter_exons_near_splice_site(gene, direction, breakpoint, exons_at_breakpoint->second))
-			return true;
-		exon_contig_annotation_index_t::const_iterator exons_after_breakpoint = exons_at_breakpoint;
-		++exons_after_breakpoint;
-		if (exons_after_breakpoint != exon_annotation_index[gene->contig].end() &&
-		    filter_exons_near_splice_site(gene, direction, breakpoint, exons_after_breakpoint->second))
-			return true;
-	}
-	if (exons_at_breakpoint != exon_annotation_index[gene->contig].begin()) {
-		exon_contig_annotation_index_t::const_iterator exons_before_breakpoint = exons_at_breakpoint;
-		--exons_before_breakpoint;
-		if (filter_exons_near_splice_site(gene, direction, breakpoint, exons_before_breakpoint->second))
-			return true;
+	// undo any changes, if the cache turns out to be malformed
+	const contigs_t saved_contigs = contigs;
+	const vector<string> saved_original_contig_names = original_contig_names;
+	try {
+		read_annotation_cache(cache, contigs, original_contig_names, gene_annotation, transcript_annotation, exon_annotation, exon_annotation_index, gene_annotation_index);
+	} catch (const out_of_range&) {
+		cerr << "WARNING: malformed annotation cache, it will be regenerated: " << cache_file_path << endl;
+		contigs = saved_contigs;
+		original_contig_names = saved_original_contig_names;
+		gene_annotation.clear();
+		transcript_annotation.clear();
+		exon_annotation.clear();
+		exon_annotation_index.clear();
+		gene_annotation_index.clear();
+		return false;
 	}
 
+	make_gene_name_map(gene_annotation, gene_names);
+	return true;
+}
+
+// check if the boundary of an exon in the given direction is a splice site, i.e., if the exon
+// - is not the first/last exon in a transcript
+// - unless:
+//   - the transcript has only one exon
+//   - the gene misses a start/stop codon (=> indicates incomplete annotation)
+bool is_exon_boundary_spliced(const exon_annotation_record_t& exon, const direction_t direction) {
+	if (direction == UPSTREAM)
+		return exon.previous_exon != NULL || // exon is not a terminal one
+		       exon.previous_exon == NULL && exon.next_exon == NULL && exon.coding_region_start != -1 || // unless transcript has only one exon
+		       exon.start == exon.coding_region_start; // or unless the first base of the exon is coding (=> gene is not annotated properly and misses preceeding exons (see TCR genes))
+	else
+		return exon.next_exon != NULL || // exon is not a terminal one
+		       exon.previous_exon == NULL && exon.next_exon == NULL && exon.coding_region_start != -1 || // unless transcript has only one exon
+		       exon.end == exon.coding_region_end; // or unless the last base of the exon is coding (=> gene is not annotated properly and misses following exons (see TCR genes))
+}
+
+// check if an exon of the given gene with a splice site within MAX_SPLICE_SITE_DISTANCE from the breakpoint
+// overlaps the region of the exon index containing the breakpoint or one of its neighbors
+bool is_breakpoint_near_splice_site(const gene_t gene, const direction_t direction, const position_t breakpoint, const exon_contig_annotation_index_t& exon_contig_annotation_index) {
+
+	// find exons in the vicinity of the breakpoint
+	exon_contig_annotation_index_t::const_iterator exons_at_breakpoint = exon_contig_annotation_index.lower_bound(breakpoint);
+	exon_contig_annotation_index_t::const_iterator first_region = exons_at_breakpoint;
+	if (first_region != exon_contig_annotation_index.begin())
+		--first_region;
+	exon_contig_annotation_index_t::const_iterator last_region = exons_at_breakpoint;
+	for (unsigned int i = 0; i < 2 && last_region != exon_contig_annotation_index.end(); ++i)
+		++last_region;
+
+	for (exon_contig_annotation_index_t::const_iterator region = first_region; region != last_region; ++region)
+		for (exon_span_t::const_iterator exon = region->second.begin(); exon != region->second.end(); ++exon)
+			if ((**exon).gene == gene &&
+			    abs(((direction == UPSTREAM) ? (**exon).start : (**exon).end) - breakpoint) <= MAX_SPLICE_SITE_DISTANCE &&
+			    is_exon_boundary_spliced(**exon, direction))
+				return true;
 	return false;
 }
 
-void annotate_alignment(alignment_t& alignment, gene_set_t& gene_set, const exon_annotation_index_t& exon_annotation_index) {
+void make_splice_site_index(gene_annotation_t& gene_annotation, const exon_annotation_t& exon_annotation, const exon_annotation_index_t& exon_annotation_index) {
+	for (gene_annotation_t::iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene) {
+		gene->spliced_breakpoints[UPSTREAM].clear();
+		gene->spliced_breakpoints[DOWNSTREAM].clear();
+		gene->downstream_splice_sites.clear();
+	}
+
+	// every position within MAX_SPLICE_SITE_DISTANCE from a splice site is a candidate
+	for (exon_annotation_t::const_iterator exon = exon_annotation.begin(); exon != exon_annotation.end(); ++exon) {
+		for (position_t position = -(position_t) MAX_SPLICE_SITE_DISTANCE; position <= (position_t) MAX_SPLICE_SITE_DISTANCE; ++position) {
+			if (is_exon_boundary_spliced(*exon, UPSTREAM))
+				exon->gene->spliced_breakpoints[UPSTREAM].push_back(exon->start + position);
+			if (is_exon_boundary_spliced(*exon, DOWNSTREAM))
+				exon->gene->spliced_breakpoints[DOWNSTREAM].push_back(exon->end + position);
+		}
+	}
+
+	// keep the candidates which are considered spliced when looking at the neighborhood of the breakpoint in the exon index,
+	// such that is_breakpoint_spliced() only needs to search the gene
+	for (gene_annotation_t::iterator gene = gene_annotation.begin(); gene != gene_annotation.end(); ++gene) {
+		if ((unsigned int) gene->contig >= exon_annotation_index.size())
+			continue;
+		const exon_contig_annotation_index_t& exon_contig_annotation_index = exon_annotation_index[gene->contig];
+		for (unsigned int direction = 0; direction <= 1; ++direction) {
+			vector<position_t>& spliced_breakpoints = gene->spliced_breakpoints[direction];
+			sort(spliced_breakpoints.begin(), spliced_breakpoints.end());
+			spliced_breakpoints.erase(unique(spliced_breakpoints.begin(), spliced_breakpoints.end()), spliced_breakpoints.end());
+			vector<position_t>::iterator kept_breakpoint = spliced_breakpoints.begin();
+			for (vector<position_t>::iterator breakpoint = spliced_breakpoints.begin(); breakpoint != spliced_breakpoints.end(); ++breakpoint)
+				if (is_breakpoint_near_splice_site(&(*gene), direction, *breakpoint, exon_contig_annotation_index))
+					*(kept_breakpoint++) = *breakpoint;
+			spliced_breakpoints.erase(kept_breakpoint, spliced_breakpoints.end());
+			vector<position_t>(spliced_breakpoints).swap(spliced_breakpoints); // release excess capacity
+		}
+
+		// for spliced alignment of reads, take the boundaries of the regions of the exon index within the gene, which are spliced in downstream direction
+		for (vector<position_t>::iterator breakpoint = gene->spliced_breakpoints[DOWNSTREAM].begin(); breakpoint != gene->spliced_breakpoints[DOWNSTREAM].end(); ++breakpoint) {
+			if (*breakpoint >= gene->start && *breakpoint <= gene->end) {
+				exon_contig_annotation_index_t::const_iterator region = exon_contig_annotation_index.lower_bound(*breakpoint);
+				if (region != exon_contig_annotation_index.end() && region->first == *breakpoint)
+					gene->downstream_splice_sites.push_back(*breakpoint);
+			}
+		}
+		vector<position_t>(gene->downstream_splice_sites).swap(gene->downstream_splice_sites); // release excess capacity
+	}
+}
+
+// check if a breakpoint is near an annotated splice site
+bool is_breakpoint_spliced(const gene_t gene, const direction_t direction, const position_t breakpoint) {
+	return binary_search(gene->spliced_breakpoints[direction].begin(), gene->spliced_breakpoints[direction].end(), breakpoint);
+}
+
+// <exon_set> is a scratch buffer, which is passed in to avoid allocations
+void annotate_alignment(alignment_t& alignment, gene_set_t& gene_set, exon_set_t& exon_set, const exon_annotation_index_t& exon_annotation_index) {
 
 	// first, try to annotate based on the boundaries (start+end) of the alignment
-	exon_set_t exon_set;
 	get_annotation_by_coordinate(alignment.contig, alignment.start, alignment.end, exon_set, exon_annotation_index);
 
 	// translate exons to genes
@@ -450,11 +944,11 @@ void annotate_alignment(alignment_t& alignment, gene_set_t& gene_set, const exon
 					gene_set_supported_by_splicing = gene_set;
 					for (gene_set_t::iterator gene = gene_set_supported_by_splicing.begin(); gene != gene_set_supported_by_splicing.end();) {
 						if (((alignment.cigar.operation(i) == BAM_CSOFT_CLIP || alignment.cigar.operation(i) == BAM_CHARD_CLIP) &&
-						     (i == 0 && !is_breakpoint_spliced(*gene, UPSTREAM, reference_position, exon_annotation_index) || // preclipped segment aligns with exon start
-						      i != 0 && !is_breakpoint_spliced(*gene, DOWNSTREAM, reference_position, exon_annotation_index)) || // postclipped segment aligns with exon end
+						     (i == 0 && !is_breakpoint_spliced(*gene, UPSTREAM, reference_position) || // preclipped segment aligns with exon start
+						      i != 0 && !is_breakpoint_spliced(*gene, DOWNSTREAM, reference_position)) || // postclipped segment aligns with exon end
 						     alignment.cigar.operation(i) == BAM_CREF_SKIP &&
-						     !is_breakpoint_spliced(*gene, DOWNSTREAM, reference_position, exon_annotation_index) && // intron aligns with exon start
-						     !is_breakpoint_spliced(*gene, UPSTREAM, reference_position + alignment.cigar.op_length(i), exon_annotation_index))) { // intron aligns with exon end
+						     !is_breakpoint_spliced(*gene, DOWNSTREAM, reference_position) && // intron aligns with exon start
+						     !is_breakpoint_spliced(*gene, UPSTREAM, reference_position + alignment.cigar.op_length(i)))) { // intron aligns with exon end
 							gene = gene_set_supported_by_splicing.erase(gene);
 						} else {
 							++gene;
@@ -499,8 +993,12 @@ void annotate_alignment(alignment_t& alignment, gene_set_t& gene_set, const exon
 void annotate_alignments(mates_t& mates, const exon_annotation_index_t& exon_annotation_index) {
 
 	// annotate each mate individually
+	gene_set_t genes;
+	exon_set_t exons;
 	for (mates_t::iterator mate = mates.begin(); mate != mates.end(); ++mate) {
-		annotate_alignment(*mate, mate->genes, exon_annotation_index);
+		genes.clear();
+		annotate_alignment(*mate, genes, exons, exon_annotation_index);
+		mate->genes = genes;
 		mate->exonic = !mate->genes.empty();
 	}
 
@@ -522,7 +1020,7 @@ void annotate_alignments(mates_t& mates, const exon_annotation_index_t& exon_ann
 
 		// try to resolve ambiguous mappings using mapping information from mate
 		gene_set_t combined;
-		combine_annotations(mates[SPLIT_READ].genes, mates[MATE1].genes, combined);
+		combine_annotations(mates[SPLIT_READ].genes.get(), mates[MATE1].genes.get(), combined);
 		if (mates[MATE1].genes.empty() || combined.size() < mates[MATE1].genes.size())
 			mates[MATE1].genes = combined;
 		if (mates[SPLIT_READ].genes.empty() || combined.size() < mates[SPLIT_READ].genes.size())
@@ -549,10 +1047,14 @@ void annotate_alignments(mates_t& mates, const exon_annotation_index_t& exon_ann
 }
 
 // when a read overlaps with multiple genes, this function returns the boundaries of the biggest one
-void get_boundaries_of_biggest_gene(gene_set_t& genes, position_t& start, position_t& end) {
+void get_boundaries_of_biggest_gene(const gene_set_t& genes, position_t& start, position_t& end) {
+	get_boundaries_of_biggest_gene(gene_span_t(genes), start, end);
+}
+
+void get_boundaries_of_biggest_gene(const gene_span_t& genes, position_t& start, position_t& end) {
 	start = -1;
 	end = -1;
-	for (gene_set_t::iterator gene = genes.begin(); gene != genes.end(); ++gene) {
+	for (gene_span_t::const_iterator gene = genes.begin(); gene != genes.end(); ++gene) {
 		if (start == -1 || start > (**gene).start)
 			start = (**gene).start;
 		if (end == -1 || end < (**gene).end)
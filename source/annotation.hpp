@@ -32,19 +32,44 @@ inline string strip_ensembl_version_number(const string& ensembl_identifier) {
 		return ensembl_identifier;
 }
 
-void read_annotation_gtf(const string& filename, const string& gtf_features_string, contigs_t& contigs, vector<string>& original_contig_names, const assembly_t& assembly, gene_annotation_t& gene_annotation, transcript_annotation_t& transcript_annotation, exon_annotation_t& exon_annotation, unordered_map<string,gene_t>& gene_names);
+// <gtf_contigs> receives the contigs named in the GTF file in the order in which they were registered
+void read_annotation_gtf(const string& filename, const string& gtf_features_string, contigs_t& contigs, vector<string>& original_contig_names, vector<contig_t>& gtf_contigs, gene_annotation_t& gene_annotation, transcript_annotation_t& transcript_annotation, exon_annotation_t& exon_annotation, unordered_map<string,gene_t>& gene_names, const unsigned int threads);
+
+// genes which exceed the boundaries of contigs are ignored
+// this is checked separately from reading the GTF file, so that the annotation can be loaded while the assembly is still being loaded
+// returns true, if genes were removed (the indices must be regenerated in this case)
+bool remove_genes_beyond_contig_ends(const assembly_t& assembly, gene_annotation_t& gene_annotation, exon_annotation_t& exon_annotation, unordered_map<string,gene_t>& gene_names);
+
+// the parsed annotation and its indices can be cached in a binary file, which is only valid for
+// the GTF file and the GTF features given by the key
+uint64_t get_annotation_cache_key(const string& gtf_file_path, const string& gtf_features);
+void write_annotation_cache(const string& cache_file_path, const uint64_t cache_key, const vector<string>& original_contig_names, const vector<contig_t>& gtf_contigs, const gene_annotation_t& gene_annotation, const transcript_annotation_t& transcript_annotation, const exon_annotation_t& exon_annotation, const exon_annotation_index_t& exon_annotation_index, const gene_annotation_index_t& gene_annotation_index);
+// returns false, if the cache file does not exist, was made from a different GTF file, or is invalid (e.g., truncated)
+bool load_annotation_cache(const string& cache_file_path, const uint64_t cache_key, contigs_t& contigs, vector<string>& original_contig_names, gene_annotation_t& gene_annotation, transcript_annotation_t& transcript_annotation, exon_annotation_t& exon_annotation, unordered_map<string,gene_t>& gene_names, exon_annotation_index_t& exon_annotation_index, gene_annotation_index_t& gene_annotation_index);
 
 template <class T> void make_annotation_index(annotation_t<T>& annotation, annotation_index_t<T*>& annotation_index, const contigs_t& contigs);
 
-bool is_breakpoint_spliced(const gene_t gene, const direction_t direction, const position_t breakpoint, const exon_annotation_index_t& exon_annotation_index);
+// collect the positions near the splice sites of all genes in sorted arrays, which are searched by is_breakpoint_spliced()
+// must be called again whenever the exon index is regenerated
+void make_splice_site_index(gene_annotation_t& gene_annotation, const exon_annotation_t& exon_annotation, const exon_annotation_index_t& exon_annotation_index);
+
+bool is_breakpoint_spliced(const gene_t gene, const direction_t direction, const position_t breakpoint);
+
+// the sets may be given as annotation_set_t or annotation_span_t, the result is appended to <combined>
+template <class S1, class S2, class T> void combine_annotations(const S1& genes1, const S2& genes2, annotation_set_t<T>& combined, bool make_union = true);
 
-template <class T> void combine_annotations(const annotation_set_t<T>& genes1, const annotation_set_t<T>& genes2, annotation_set_t<T>& combined, bool make_union = true);
+// get the features overlapping the given position without copying them
+// the span is valid as long as the index is not modified
+template <class T> annotation_span_t<T> get_annotation_at_position(const contig_t contig, const position_t position, const annotation_index_t<T>& annotation_index);
 
+// get the features overlapping the given range, the result is written to <annotation_set>
+// the set can be reused across calls to avoid allocations
 template <class T> void get_annotation_by_coordinate(const contig_t contig, const position_t start, const position_t end, annotation_set_t<T>& annotation_set, const annotation_index_t<T>& annotation_index);
 
 void annotate_alignments(mates_t& mates, const exon_annotation_index_t& exon_annotation_index);
 
-void get_boundaries_of_biggest_gene(gene_set_t& genes, position_t& start, position_t& end);
+void get_boundaries_of_biggest_gene(const gene_span_t& genes, position_t& start, position_t& end);
+void get_boundaries_of_biggest_gene(const gene_set_t& genes, position_t& start, position_t& end);
 
 int get_spliced_distance(const contig_t contig, const position_t position1, const position_t position2, const gene_t gene, const exon_annotation_index_t& exon_annotation_index);
 
@@ -22,29 +22,59 @@ using namespace std;
 // - chr1:10,000-11,999 gene1
 // - chr1:12,000-13,000 gene1+gene2
 // - chr1:13,001-20,000 gene1
+// the regions are bounded by the positions start-1 and end of all features;
+// they are found by sweeping over the boundaries and keeping track of the features overlapping the current one
+template <class T> bool starts_before(const T* x, const T* y) {
+	return x->start < y->start;
+}
 template <class T> void make_annotation_index(annotation_t<T>& annotation, annotation_index_t<T*>& annotation_index) {
-	annotation_index.resize(annotation.size()); // create a contig_annotation_index_t for each contig
+
+	// group features by contig
+	vector< vector<T*> > features_by_contig;
 	for (typename annotation_t<T>::iterator feature = annotation.begin(); feature != annotation.end(); ++feature) {
+		if (features_by_contig.size() <= feature->contig)
+			features_by_contig.resize(feature->contig + 1);
+		features_by_contig[feature->contig].push_back(&(*feature));
+	}
+
+	annotation_index.clear();
+	annotation_index.resize(max(annotation.size(), features_by_contig.size())); // create a contig_annotation_index_t for each contig
+	for (contig_t contig = 0; contig < features_by_contig.size(); ++contig) {
+		vector<T*>& features = features_by_contig[contig];
+		stable_sort(features.begin(), features.end(), starts_before<T>);
 
-		typename contig_annotation_index_t<T*>::const_iterator overlapping_features = annotation_index[feature->contig].lower_bound(feature->end);
-		if (overlapping_features == annotation_index[feature->contig].end())
-			annotation_index[feature->contig][feature->end]; // this creates an empty gene set, if it does not exist yet
-		else
-			annotation_index[feature->contig][feature->end] = overlapping_features->second;
-
-		overlapping_features = annotation_index[feature->contig].lower_bound(feature->start-1);
-		if (overlapping_features == annotation_index[feature->contig].end())
-			annotation_index[feature->contig][feature->start-1]; // this creates an empty gene set, if it does not exist yet
-		else
-			annotation_index[feature->contig][feature->start-1] = overlapping_features->second;
-
-		// add the gene to all gene sets between start and end of the gene
-		for (typename contig_annotation_index_t<T*>::iterator annotation_set = annotation_index[feature->contig].lower_bound(feature->end); annotation_set->first >= feature->start; --annotation_set)
-			annotation_set->second.insert(&(*feature));
+		vector<position_t> boundaries;
+		boundaries.reserve(features.size() * 2);
+		for (typename vector<T*>::iterator feature = features.begin(); feature != features.end(); ++feature) {
+			boundaries.push_back((**feature).start - 1);
+			boundaries.push_back((**feature).end);
+		}
+		sort(boundaries.begin(), boundaries.end());
+		boundaries.erase(unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+		vector<unsigned int> offsets;
+		offsets.reserve(boundaries.size() + 1);
+		vector<T*> pool;
+		annotation_set_t<T*> overlapping_features;
+		typename vector<T*>::iterator next_feature = features.begin();
+		for (vector<position_t>::iterator boundary = boundaries.begin(); boundary != boundaries.end(); ++boundary) {
+			for (; next_feature != features.end() && (**next_feature).start <= *boundary; ++next_feature)
+				overlapping_features.insert(*next_feature);
+			for (typename annotation_set_t<T*>::iterator feature = overlapping_features.begin(); feature != overlapping_features.end();) {
+				if ((**feature).end < *boundary)
+					feature = overlapping_features.erase(feature);
+				else
+					++feature;
+			}
+			offsets.push_back(pool.size());
+			pool.insert(pool.end(), overlapping_features.begin(), overlapping_features.end());
+		}
+		offsets.push_back(pool.size());
+		annotation_index[contig].assign(boundaries, offsets, pool);
 	}
 }
 
-template <class T> void combine_annotations(const annotation_set_t<T>& genes1, const annotation_set_t<T>& genes2, annotation_set_t<T>& combined, bool make_union) {
+template <class S1, class S2, class T> void combine_annotations(const S1& genes1, const S2& genes2, annotation_set_t<T>& combined, bool make_union) {
 	// when the two ends of a read map to different genes, the mapping is ambiguous
 	// in this case, we try to resolve the ambiguity by taking the gene that both - start and end - overlap with
 	set_intersection(genes1.begin(), genes1.end(), genes2.begin(), genes2.end(), back_inserter(combined));
@@ -52,50 +82,75 @@ template <class T> void combine_annotations(const annotation_set_t<T>& genes1, c
 		set_union(genes1.begin(), genes1.end(), genes2.begin(), genes2.end(), back_inserter(combined));
 }
 
+template <class T> annotation_span_t<T> get_annotation_at_position(const contig_t contig, const position_t position, const annotation_index_t<T>& annotation_index) {
+	if ((unsigned int) contig >= annotation_index.size())
+		return annotation_span_t<T>();
+	typename contig_annotation_index_t<T>::const_iterator region = annotation_index[contig].lower_bound(position);
+	if (region == annotation_index[contig].end())
+		return annotation_span_t<T>();
+	return region->second;
+}
+
+template <class T> inline bool is_in_either_span(const T& feature, const annotation_span_t<T>& span1, const annotation_span_t<T>& span2) {
+	return binary_search(span1.begin(), span1.end(), feature) || binary_search(span2.begin(), span2.end(), feature);
+}
+
 template <class T> void get_annotation_by_coordinate(const contig_t contig, position_t start, position_t end, annotation_set_t<T>& annotation_set, const annotation_index_t<T>& annotation_index) {
-	if ((unsigned int) contig >= annotation_index.size()) {
-		annotation_set.clear(); // return empty set
-		return;
-	}
+	annotation_set.clear();
+	if ((unsigned int) contig >= annotation_index.size())
+		return; // return empty set
 
 	if (start == end) {
 
 		// get all features at position
-		typename contig_annotation_index_t<T>::const_iterator position = annotation_index[contig].lower_bound(start);
-		if (position != annotation_index[contig].end())
-			annotation_set = position->second;
-		else
-			annotation_set.clear(); // return empty set
+		annotation_span_t<T> features = get_annotation_at_position(contig, start, annotation_index);
+		annotation_set.assign(features.begin(), features.end());
 
 	} else {
 		if (start > end)
 			swap(start, end);
 
 		// get all features at start (+ 2bp)
-		annotation_set_t<T> result_start;
+		annotation_span_t<T> features_at_start, features_after_start;
 		typename contig_annotation_index_t<T>::const_iterator position_start = annotation_index[contig].lower_bound(start);
 		if (position_start != annotation_index[contig].end()) {
-			result_start = position_start->second;
+			features_at_start = position_start->second;
 			if (position_start->first - start <= 2) {
 				++position_start;
 				if (position_start != annotation_index[contig].end())
-					result_start.insert(position_start->second.begin(), position_start->second.end());
+					features_after_start = position_start->second;
 			}
 		}
 
 		// get all features at end (- 2 bp)
-		annotation_set_t<T> result_end;
+		annotation_span_t<T> features_at_end, features_before_end;
 		typename contig_annotation_index_t<T>::const_iterator position_end = annotation_index[contig].lower_bound(end);
 		if (position_end != annotation_index[contig].end())
-			result_end = position_end->second;
+			features_at_end = position_end->second;
 		if (position_end != annotation_index[contig].begin() && annotation_index[contig].size() > 0) {
 			--position_end;
 			if (end - position_end->first <= 2)
-				result_end.insert(position_end->second.begin(), position_end->second.end());
+				features_before_end = position_end->second;
 		}
 
-		// take intersection of genes at start and end
-		combine_annotations(result_start, result_end, annotation_set);
+		// take intersection of features at start and end (or the union, if the intersection is empty)
+		// the result is collected directly in <annotation_set> without making temporary sets
+		for (typename annotation_span_t<T>::const_iterator feature = features_at_start.begin(); feature != features_at_start.end(); ++feature)
+			if (is_in_either_span(*feature, features_at_end, features_before_end))
+				annotation_set.push_back(*feature);
+		size_t features_in_annotation_set = annotation_set.size();
+		for (typename annotation_span_t<T>::const_iterator feature = features_after_start.begin(); feature != features_after_start.end(); ++feature)
+			if (!binary_search(features_at_start.begin(), features_at_start.end(), *feature) && is_in_either_span(*feature, features_at_end, features_before_end))
+				annotation_set.push_back(*feature);
+		if (annotation_set.size() > features_in_annotation_set)
+			sort(annotation_set.begin(), annotation_set.end());
+		if (annotation_set.empty()) {
+			annotation_set.insert(annotation_set.end(), features_at_start.begin(), features_at_start.end());
+			annotation_set.insert(annotation_set.end(), features_after_start.begin(), features_after_start.end());
+			annotation_set.insert(annotation_set.end(), features_at_end.begin(), features_at_end.end());
+			annotation_set.insert(annotation_set.end(), features_before_end.begin(), features_before_end.end());
+			sort(annotation_set.begin(), annotation_set.end());
+			annotation_set.erase(unique(annotation_set.begin(), annotation_set.end()), annotation_set.end());
+		}
 	}
 }
-
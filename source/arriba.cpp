@@ -8,6 +8,7 @@
 #include <string>
 #include <sys/resource.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "common.hpp"
 #include "annotation.hpp"
@@ -88,6 +89,19 @@ int main(int argc, char **argv) {
 	// parse command-line options
 	options_t options = parse_arguments(argc, argv);
 
+	// convert the assembly to a cache file
+	if (!options.assembly_cache_file.empty()) {
+		contigs_t contigs;
+		vector<string> original_contig_names;
+		cout << get_time_string() << " Loading assembly from '" << options.assembly_file << "' " << endl;
+		assembly_t assembly;
+		load_assembly(assembly, options.assembly_file, contigs, original_contig_names, "*", false, options.threads); // the cache holds all contigs
+		cout << get_time_string() << " Writing assembly cache to '" << options.assembly_cache_file << "' " << endl;
+		write_assembly_cache(assembly, original_contig_names, options.assembly_cache_file);
+		cout << get_time_string() << " Done" << endl;
+		return 0;
+	}
+
 	// load sequences of contigs from assembly
 	if (!options.filters.at("uninteresting_contigs"))
 		options.interesting_contigs = "*"; // load all contigs when the filter is disabled
@@ -95,22 +109,48 @@ int main(int argc, char **argv) {
 	vector<string> original_contig_names; // "chr" prefix is removed from contig names to ensure compatibility between assembly and annotation; this vector stores the original names
 	cout << get_time_string() << " Loading assembly from '" << options.assembly_file << "' " << endl;
 	assembly_t assembly;
-	load_assembly(assembly, options.assembly_file, contigs, original_contig_names, options.interesting_contigs);
+	assembly_loader_t* assembly_loader = start_loading_assembly(assembly, options.assembly_file, contigs, original_contig_names, options.interesting_contigs, options.lazy_assembly_loading, options.threads);
 
 	// load GTF file
-	// must be loaded after assembly to check if genes exceed the boundaries of contigs
+	// while the sequences of the assembly are being parsed in the background
 	cout << get_time_string() << " Loading annotation from '" << options.gene_annotation_file << "' " << endl << flush;
 	gene_annotation_t gene_annotation;
 	transcript_annotation_t transcript_annotation;
 	exon_annotation_t exon_annotation;
 	unordered_map<string,gene_t> gene_names;
-	read_annotation_gtf(options.gene_annotation_file, options.gtf_features, contigs, original_contig_names, assembly, gene_annotation, transcript_annotation, exon_annotation, gene_names);
-
-	// sort genes and exons by coordinate (make index)
 	exon_annotation_index_t exon_annotation_index;
-	make_annotation_index(exon_annotation, exon_annotation_index);
 	gene_annotation_index_t gene_annotation_index;
-	make_annotation_index(gene_annotation, gene_annotation_index);
+	uint64_t annotation_cache_key = (options.annotation_cache_file.empty()) ? 0 : get_annotation_cache_key(options.gene_annotation_file, options.gtf_features);
+	vector<contig_t> gtf_contigs; // needed to write the annotation cache
+	if (options.annotation_cache_file.empty() || !load_annotation_cache(options.annotation_cache_file, annotation_cache_key, contigs, original_contig_names, gene_annotation, transcript_annotation, exon_annotation, gene_names, exon_annotation_index, gene_annotation_index)) {
+		read_annotation_gtf(options.gene_annotation_file, options.gtf_features, contigs, original_contig_names, gtf_contigs, gene_annotation, transcript_annotation, exon_annotation, gene_names, options.threads);
+
+		// sort genes and exons by coordinate (make index)
+		make_annotation_index(exon_annotation, exon_annotation_index);
+		make_annotation_index(gene_annotation, gene_annotation_index);
+
+		if (!options.annotation_cache_file.empty()) {
+			cout << get_time_string() << " Writing annotation cache to '" << options.annotation_cache_file << "' " << endl;
+			write_annotation_cache(options.annotation_cache_file, annotation_cache_key, original_contig_names, gtf_contigs, gene_annotation, transcript_annotation, exon_annotation, exon_annotation_index, gene_annotation_index);
+		}
+	}
+	finish_loading_assembly(assembly_loader);
+	if (remove_genes_beyond_contig_ends(assembly, gene_annotation, exon_annotation, gene_names)) {
+		// index needs to be regenerated after removing genes
+		exon_annotation_index.clear();
+		make_annotation_index(exon_annotation, exon_annotation_index);
+		gene_annotation_index.clear();
+		make_annotation_index(gene_annotation, gene_annotation_index);
+	}
+	make_splice_site_index(gene_annotation, exon_annotation, exon_annotation_index);
+
+	// load regions to which reading of alignments is restricted
+	regions_t regions;
+	if (!options.regions_file.empty()) {
+		cout << get_time_string() << " Loading regions from '" << options.regions_file << "' " << flush;
+		cout << "(total=" << load_regions(options.regions_file, contigs, gene_names, regions) << ")" << endl;
+		crash(regions.empty(), "no valid regions found in '" + options.regions_file + "'");
+	}
 
 	// prevent htslib from downloading the assembly via the Internet, if CRAM is used
 	setenv("REF_PATH", ".", 0);
@@ -120,14 +160,22 @@ int main(int argc, char **argv) {
 	unsigned long int mapped_reads = 0;
 	vector<unsigned long int> mapped_viral_reads_by_contig;
 	coverage_t coverage;
+	unordered_set<string> read_through_names; // needed to compute the coverage in a separate pass
 	if (!options.chimeric_bam_file.empty()) { // when STAR was run with --chimOutType SeparateSAMold, chimeric alignments must be read from a separate file named Chimeric.out.sam
 		cout << get_time_string() << " Reading chimeric alignments from '" << options.chimeric_bam_file << "' " << flush;
-		cout << "(total=" << read_chimeric_alignments(options.chimeric_bam_file, assembly, options.assembly_file, chimeric_alignments, mapped_reads, mapped_viral_reads_by_contig, coverage, contigs, original_contig_names, options.interesting_contigs, options.viral_contigs, gene_annotation_index, true, false, options.external_duplicate_marking, options.max_itd_length) << ")" << endl;
+		cout << "(total=" << read_chimeric_alignments(options.chimeric_bam_file, assembly, options.assembly_file, chimeric_alignments, mapped_reads, mapped_viral_reads_by_contig, coverage, contigs, original_contig_names, options.interesting_contigs, options.viral_contigs, gene_annotation_index, true, false, options.external_duplicate_marking, options.max_itd_length, options.threads, regions_t(), false, NULL) << ")" << endl;
 	}
 
 	// extract chimeric alignments and read-through alignments from Aligned.out.bam
 	cout << get_time_string() << " Reading chimeric alignments from '" << options.rna_bam_file << "' " << flush;
-	cout << "(total=" << read_chimeric_alignments(options.rna_bam_file, assembly, options.assembly_file, chimeric_alignments, mapped_reads, mapped_viral_reads_by_contig, coverage, contigs, original_contig_names, options.interesting_contigs, options.viral_contigs, gene_annotation_index, !options.chimeric_bam_file.empty(), true, options.external_duplicate_marking, options.max_itd_length) << ")" << endl;
+	cout << "(total=" << read_chimeric_alignments(options.rna_bam_file, assembly, options.assembly_file, chimeric_alignments, mapped_reads, mapped_viral_reads_by_contig, coverage, contigs, original_contig_names, options.interesting_contigs, options.viral_contigs, gene_annotation_index, !options.chimeric_bam_file.empty(), true, options.external_duplicate_marking, options.max_itd_length, options.threads, regions, options.sharded_reading, (options.targeted_coverage) ? &read_through_names : NULL) << ")" << endl;
+
+	// compute the coverage only near the chimeric alignments, where the breakpoints of fusions can be
+	if (options.targeted_coverage) {
+		cout << get_time_string() << " Computing coverage near chimeric alignments " << flush;
+		cout << "(regions=" << read_coverage_near_chimeric_alignments(options.rna_bam_file, assembly, options.assembly_file, chimeric_alignments, read_through_names, coverage, contigs, options.viral_contigs, gene_annotation_index, !options.chimeric_bam_file.empty(), options.external_duplicate_marking, options.max_itd_length, options.threads) << ")" << endl;
+		read_through_names.clear();
+	}
 
 	// convert viral contigs to vector of booleans for faster lookup
 	vector<bool> viral_contigs(contigs.size());
@@ -150,7 +198,7 @@ int main(int argc, char **argv) {
 	strandedness_t strandedness = options.strandedness;
 	if (options.strandedness == STRANDEDNESS_AUTO) {
 		cout << get_time_string() << " Detecting strandedness " << flush;
-		strandedness = detect_strandedness(chimeric_alignments, gene_annotation_index, exon_annotation_index);
+		strandedness = detect_strandedness(chimeric_alignments, gene_annotation_index);
 		switch (strandedness) {
 			case STRANDEDNESS_YES: cout << "(yes)" << endl; break;
 			case STRANDEDNESS_REVERSE: cout << "(reverse)" << endl; break;
@@ -169,7 +217,7 @@ int main(int argc, char **argv) {
 		position_t region_start = 0;
 		for (exon_contig_annotation_index_t::iterator region = contig->begin(); region != contig->end(); ++region) {
 			gene_t previous_gene = NULL;
-			for (exon_set_t::iterator overlapping_exon = region->second.begin(); overlapping_exon != region->second.end(); ++overlapping_exon) {
+			for (exon_span_t::const_iterator overlapping_exon = region->second.begin(); overlapping_exon != region->second.end(); ++overlapping_exon) {
 				gene_t& current_gene = (**overlapping_exon).gene;
 				if (previous_gene != current_gene) {
 					current_gene->exonic_length += region->first - region_start;
@@ -188,15 +236,18 @@ int main(int argc, char **argv) {
 		annotate_alignments(mates->second, exon_annotation_index);
 
 	// if the alignment does not map to an exon, try to map it to a gene
+	gene_set_t genes; // reused for all alignments to avoid allocations
 	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
 		for (mates_t::iterator mate = chimeric_alignment->second.begin(); mate != chimeric_alignment->second.end(); ++mate) {
-			if (mate->genes.empty())
-				get_annotation_by_coordinate(mate->contig, mate->start, mate->end, mate->genes, gene_annotation_index);
+			if (mate->genes.empty()) {
+				get_annotation_by_coordinate(mate->contig, mate->start, mate->end, genes, gene_annotation_index);
+				mate->genes = genes;
+			}
 		}
 		// try to resolve ambiguous mappings using mapping information from mate
 		if (chimeric_alignment->second.size() == 3) {
 			gene_set_t combined;
-			combine_annotations(chimeric_alignment->second[SPLIT_READ].genes, chimeric_alignment->second[MATE1].genes, combined);
+			combine_annotations(chimeric_alignment->second[SPLIT_READ].genes.get(), chimeric_alignment->second[MATE1].genes.get(), combined);
 			if (chimeric_alignment->second[MATE1].genes.empty() || combined.size() < chimeric_alignment->second[MATE1].genes.size())
 				chimeric_alignment->second[MATE1].genes = combined;
 			if (chimeric_alignment->second[SPLIT_READ].genes.empty() || combined.size() < chimeric_alignment->second[SPLIT_READ].genes.size())
@@ -205,7 +256,7 @@ int main(int argc, char **argv) {
 	}
 
 	// if the alignment maps neither to an exon nor to a gene, make a dummy gene which subsumes all alignments with a distance of 10kb
-	gene_annotation_t unmapped_alignments;
+	vector<gene_annotation_record_t> unmapped_alignments;
 	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
 		gene_annotation_record_t gene_annotation_record;
 		if (chimeric_alignment->second.size() == 3) { // split-read
@@ -230,17 +281,19 @@ int main(int argc, char **argv) {
 		}
 	}
 	if (unmapped_alignments.size() > 0) {
-		unmapped_alignments.sort();
+		stable_sort(unmapped_alignments.begin(), unmapped_alignments.end());
 		gene_annotation_record_t gene_annotation_record;
 		gene_annotation_record.contig = unmapped_alignments.begin()->contig;
 		gene_annotation_record.start = unmapped_alignments.begin()->start;
 		gene_annotation_record.end = unmapped_alignments.begin()->end;
 		gene_annotation_record.strand = FORWARD;
+		gene_annotation_record.gene_id = "";
+		gene_annotation_record.name = "";
 		gene_annotation_record.exonic_length = 10000; //TODO more exact estimation of exonic_length
 		gene_annotation_record.is_dummy = true;
 		gene_annotation_record.is_protein_coding = false;
 		gene_contig_annotation_index_t::iterator next_known_gene = gene_annotation_index[unmapped_alignments.begin()->contig].lower_bound(unmapped_alignments.begin()->end);
-		for (gene_annotation_t::iterator unmapped_alignment = next(unmapped_alignments.begin()); ; ++unmapped_alignment) {
+		for (vector<gene_annotation_record_t>::iterator unmapped_alignment = next(unmapped_alignments.begin()); ; ++unmapped_alignment) {
 			// subsume all unmapped alignments in a range of 10kb into a dummy gene
 			if (unmapped_alignment == unmapped_alignments.end() || // all unmapped alignments have been processed => add last record
 			    gene_annotation_record.end+10000 < unmapped_alignment->start || // current alignment is too far away
@@ -266,18 +319,21 @@ int main(int argc, char **argv) {
 		if (chimeric_alignment->second.size() == 3) { // split read
 			if (chimeric_alignment->second[MATE1].genes.empty() || chimeric_alignment->second[SPLIT_READ].genes.empty()) {
 				const position_t breakpoint = (chimeric_alignment->second[SPLIT_READ].strand == FORWARD) ? chimeric_alignment->second[SPLIT_READ].start : chimeric_alignment->second[SPLIT_READ].end;
-				get_annotation_by_coordinate(chimeric_alignment->second[SPLIT_READ].contig, breakpoint, breakpoint, chimeric_alignment->second[SPLIT_READ].genes, gene_annotation_index);
+				get_annotation_by_coordinate(chimeric_alignment->second[SPLIT_READ].contig, breakpoint, breakpoint, genes, gene_annotation_index);
+				chimeric_alignment->second[SPLIT_READ].genes = genes;
 				chimeric_alignment->second[MATE1].genes = chimeric_alignment->second[SPLIT_READ].genes;
 			}
 			if (chimeric_alignment->second[SUPPLEMENTARY].genes.empty()) {
 				const position_t breakpoint = (chimeric_alignment->second[SUPPLEMENTARY].strand == FORWARD) ? chimeric_alignment->second[SUPPLEMENTARY].end : chimeric_alignment->second[SUPPLEMENTARY].start;
-				get_annotation_by_coordinate(chimeric_alignment->second[SUPPLEMENTARY].contig, breakpoint, breakpoint, chimeric_alignment->second[SUPPLEMENTARY].genes, gene_annotation_index);
+				get_annotation_by_coordinate(chimeric_alignment->second[SUPPLEMENTARY].contig, breakpoint, breakpoint, genes, gene_annotation_index);
+				chimeric_alignment->second[SUPPLEMENTARY].genes = genes;
 			}
 		} else { // discordant mates
 			for (mates_t::iterator mate = chimeric_alignment->second.begin(); mate != chimeric_alignment->second.end(); ++mate) {
 				if (mate->genes.empty()) {
 					const position_t breakpoint = (mate->strand == FORWARD) ? mate->end : mate->start;
-					get_annotation_by_coordinate(mate->contig, breakpoint, breakpoint, mate->genes, gene_annotation_index);
+					get_annotation_by_coordinate(mate->contig, breakpoint, breakpoint, genes, gene_annotation_index);
+					mate->genes = genes;
 				}
 			}
 		}
@@ -293,8 +349,9 @@ int main(int argc, char **argv) {
 				for (auto dummy_gene = mate->genes.begin(); dummy_gene != mate->genes.end(); ++dummy_gene)
 					if ((**dummy_gene).start <= breakpoint && (**dummy_gene).end >= breakpoint)
 						encompassing_dummy_gene = *dummy_gene;
-				mate->genes.clear();
-				mate->genes.push_back(encompassing_dummy_gene);
+				gene_set_t encompassing_dummy_gene_set;
+				encompassing_dummy_gene_set.push_back(encompassing_dummy_gene);
+				mate->genes = encompassing_dummy_gene_set;
 			}
 		}
 		// split-reads require special treatment, because mate1 and mate2 may be annotated with different dummy genes
@@ -310,10 +367,10 @@ int main(int argc, char **argv) {
 				for (auto dummy_gene = chimeric_alignment->second[SPLIT_READ].genes.begin(); dummy_gene != chimeric_alignment->second[SPLIT_READ].genes.end(); ++dummy_gene)
 					if ((**dummy_gene).start <= breakpoint && (**dummy_gene).end >= breakpoint)
 						encompassing_dummy_gene = *dummy_gene;
-				chimeric_alignment->second[MATE1].genes.clear();
-				chimeric_alignment->second[SPLIT_READ].genes.clear();
-				chimeric_alignment->second[MATE1].genes.push_back(encompassing_dummy_gene);
-				chimeric_alignment->second[SPLIT_READ].genes.push_back(encompassing_dummy_gene);
+				gene_set_t encompassing_dummy_gene_set;
+				encompassing_dummy_gene_set.push_back(encompassing_dummy_gene);
+				chimeric_alignment->second[MATE1].genes = encompassing_dummy_gene_set;
+				chimeric_alignment->second[SPLIT_READ].genes = encompassing_dummy_gene_set;
 			}
 		}
 	}
@@ -375,7 +432,7 @@ int main(int argc, char **argv) {
 
 	if (options.filters.at("homopolymer")) {
 		cout << get_time_string() << " Filtering breakpoints adjacent to homopolymers >=" << options.homopolymer_length << "nt " << flush;
-		cout << "(remaining=" << filter_homopolymer(chimeric_alignments, options.homopolymer_length, exon_annotation_index) << ")" << endl;
+		cout << "(remaining=" << filter_homopolymer(chimeric_alignments, options.homopolymer_length) << ")" << endl;
 	}
 
 	if (options.filters.at("small_insert_size")) {
@@ -410,7 +467,7 @@ int main(int argc, char **argv) {
 
 	cout << get_time_string() << " Finding fusions and counting supporting reads " << flush;
 	fusions_t fusions;
-	cout << "(total=" << find_fusions(chimeric_alignments, fusions, exon_annotation_index, max_mate_gap, options.subsampling_threshold) << ")" << endl;
+	cout << "(total=" << find_fusions(chimeric_alignments, fusions, max_mate_gap, options.subsampling_threshold) << ")" << endl;
 
 	if (!options.genomic_breakpoints_file.empty()) {
 		cout << get_time_string() << " Marking fusions with support from whole-genome sequencing in '" << options.genomic_breakpoints_file << "' " << flush;
@@ -425,7 +482,7 @@ int main(int argc, char **argv) {
 	// this step must come before the e-value calculation, or else multi-mapping reads are counted redundantly
 	if (options.filters.at("multimappers")) {
 		cout << get_time_string() << " Filtering multi-mapping fusions by alignment score and read support " << flush;
-		cout << "(remaining=" << filter_multimappers(chimeric_alignments, fusions, exon_annotation_index, assembly) << ")" << endl;
+		cout << "(remaining=" << filter_multimappers(chimeric_alignments, fusions, assembly) << ")" << endl;
 	}
 
 	// this step must come after the 'merge_adjacent' filter,
@@ -561,7 +618,7 @@ int main(int argc, char **argv) {
 	// this step must come near the end, because it is expensive in terms of memory and CPU consumption
 	if (options.filters.at("mismappers")) {
 		cout << get_time_string() << " Re-aligning chimeric reads to filter fusions with >=" << (options.max_mismapper_fraction*100) << "% mis-mappers " << flush;
-		cout << "(remaining=" << filter_mismappers(fusions, kmer_indices, kmer_length, assembly, exon_annotation_index, options.max_mismapper_fraction, max_mate_gap) << ")" << endl;
+		cout << "(remaining=" << filter_mismappers(fusions, kmer_indices, kmer_length, assembly, options.max_mismapper_fraction, max_mate_gap) << ")" << endl;
 	}
 
 	// this step must come after all heuristic filters, to undo them
@@ -1,8 +1,21 @@
+#include <atomic>
 #include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "faidx.h"
 #include "sam.h"
 #include "common.hpp"
 #include "annotation.hpp"
@@ -25,35 +38,423 @@ string dna_to_reverse_complement(const string& dna) {
 	return reverse_complement;
 }
 
-void load_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs) {
-
-	// read FastA file line by line
-	autodecompress_file_t fasta_file(fasta_file_path);
-	string line;
-	contig_t current_contig = USHRT_MAX;
-	while (fasta_file.getline(line)) {
-		if (!line.empty()) {
-
-			// get contig name
-			if (line[0] == '>') {
-				crash(contigs.size() == USHRT_MAX - 1, "too many contigs");
-				istringstream iss(line.substr(1));
-				string contig_name;
-				iss >> contig_name;
-				pair<contigs_t::iterator,bool> new_contig = contigs.insert(pair<string,contig_t>(removeChr(contig_name), contigs.size()));
-				current_contig = new_contig.first->second;
-				if (original_contig_names.size() < contigs.size())
-					original_contig_names.resize(contigs.size());
-				original_contig_names[current_contig] = contig_name;
-				if (!is_interesting_contig(contig_name, interesting_contigs))
-					current_contig = USHRT_MAX; // skip uninteresting contigs
-
-			// get sequence
-			} else if (current_contig != USHRT_MAX) { // skip line if contig is undefined or not interesting
-				std::transform(line.begin(), line.end(), line.begin(), (int (*)(int))std::toupper); // convert sequence to uppercase
-				assembly[current_contig] += line;
+// when the assembly is loaded lazily, sequences are fetched from the FastA file in blocks of this size
+const string::size_type LAZY_BLOCK_SIZE = 65536;
+
+class lazy_fasta_file_t {
+	public:
+		lazy_fasta_file_t(const string& fasta_file_path);
+		~lazy_fasta_file_t();
+		faidx_t* fasta_index;
+		mutex fasta_index_mutex; // faidx_t must not be used by multiple threads concurrently
+		vector<lazy_contig_t*> contigs;
+};
+
+class lazy_contig_t {
+	public:
+		lazy_contig_t(lazy_fasta_file_t* fasta_file, const string& name, const string::size_type length);
+		~lazy_contig_t();
+		const string& get_block(const string::size_type block) const;
+	private:
+		lazy_fasta_file_t* fasta_file;
+		string name;
+		string::size_type length;
+		// blocks are never freed once they have been loaded, so they can be read without locking
+		mutable vector< atomic<string*> > blocks;
+};
+
+lazy_fasta_file_t::lazy_fasta_file_t(const string& fasta_file_path) {
+	fasta_index = fai_load3(fasta_file_path.c_str(), NULL, NULL, 0); // bgzip-compressed files need a .gzi index in addition
+	crash(fasta_index == NULL, "failed to load index of assembly (run 'samtools faidx' to make one): " + fasta_file_path + ".fai");
+}
+
+lazy_fasta_file_t::~lazy_fasta_file_t() {
+	for (vector<lazy_contig_t*>::iterator contig = contigs.begin(); contig != contigs.end(); ++contig)
+		delete *contig;
+	fai_destroy(fasta_index);
+}
+
+lazy_contig_t::lazy_contig_t(lazy_fasta_file_t* fasta_file, const string& name, const string::size_type length):
+	fasta_file(fasta_file), name(name), length(length), blocks((length + LAZY_BLOCK_SIZE - 1) / LAZY_BLOCK_SIZE) {
+	for (string::size_type block = 0; block < blocks.size(); ++block)
+		blocks[block].store(NULL);
+}
+
+lazy_contig_t::~lazy_contig_t() {
+	for (string::size_type block = 0; block < blocks.size(); ++block)
+		delete blocks[block].load();
+}
+
+const string& lazy_contig_t::get_block(const string::size_type block) const {
+	string* loaded_block = blocks[block].load(memory_order_acquire);
+	if (loaded_block == NULL) {
+		lock_guard<mutex> fasta_index_lock(fasta_file->fasta_index_mutex);
+		loaded_block = blocks[block].load(memory_order_relaxed);
+		if (loaded_block == NULL) { // the block has not been loaded by another thread in the meantime
+			hts_pos_t start = block * LAZY_BLOCK_SIZE;
+			hts_pos_t end = min(start + LAZY_BLOCK_SIZE, length) - 1;
+			hts_pos_t fetched_length = 0;
+			char* sequence = faidx_fetch_seq64(fasta_file->fasta_index, name.c_str(), start, end, &fetched_length);
+			crash(sequence == NULL || fetched_length != end - start + 1, "failed to fetch sequence of contig from assembly: " + name);
+			loaded_block = new string(sequence, fetched_length);
+			free(sequence);
+			std::transform(loaded_block->begin(), loaded_block->end(), loaded_block->begin(), (int (*)(int))std::toupper); // convert sequence to uppercase
+			blocks[block].store(loaded_block, memory_order_release);
+		}
+	}
+	return *loaded_block;
+}
+
+char contig_sequence_t::get_lazy_base(const string::size_type position) const {
+	return lazy_contig->get_block(position / LAZY_BLOCK_SIZE)[position % LAZY_BLOCK_SIZE];
+}
+
+string contig_sequence_t::get_lazy_substr(const string::size_type position, const string::size_type length) const {
+	string result;
+	result.reserve(length);
+	for (string::size_type block_position = position; block_position < position + length; block_position = (block_position / LAZY_BLOCK_SIZE + 1) * LAZY_BLOCK_SIZE) {
+		const string& block = lazy_contig->get_block(block_position / LAZY_BLOCK_SIZE);
+		result.append(block, block_position % LAZY_BLOCK_SIZE, position + length - block_position);
+	}
+	return result;
+}
+
+assembly_t::~assembly_t() {
+	if (mapped_cache_file != NULL)
+		munmap(mapped_cache_file, mapped_cache_file_size);
+	delete lazy_fasta_file;
+}
+
+// packs a sequence into 2-bit encoding base by base, so that it needs not be held in memory as plain text
+class sequence_packer_t {
+	public:
+		sequence_packer_t(string& packed_bases, vector<sequence_run_t>& runs): base_count(0), packed_bases(packed_bases), runs(runs) {};
+		inline void append(const char base) {
+			uint8_t code;
+			switch (base) {
+				case 'A': code = 0; break;
+				case 'C': code = 1; break;
+				case 'G': code = 2; break;
+				case 'T': code = 3; break;
+				default: // store other characters (mostly N) as runs
+					code = 0;
+					if (!runs.empty() && runs.back().end == base_count && runs.back().base == base) {
+						runs.back().end++;
+					} else {
+						sequence_run_t run = { (uint32_t) base_count, (uint32_t) base_count + 1, base, {0,0,0} };
+						runs.push_back(run);
+					}
+			}
+			if (base_count % 4 == 0)
+				packed_bases.push_back(0);
+			packed_bases[base_count/4] |= code << ((base_count % 4) * 2);
+			base_count++;
+		};
+		string::size_type base_count;
+	private:
+		string& packed_bases;
+		vector<sequence_run_t>& runs;
+};
+
+void assembly_t::add_contig(const contig_t contig, const string& sequence) {
+	string contig_packed_bases;
+	contig_packed_bases.reserve((sequence.size() + 3) / 4);
+	vector<sequence_run_t> contig_runs;
+	sequence_packer_t sequence_packer(contig_packed_bases, contig_runs);
+	for (string::const_iterator base = sequence.begin(); base != sequence.end(); ++base)
+		sequence_packer.append(*base);
+	add_packed_contig(contig, contig_packed_bases, contig_runs, sequence_packer.base_count);
+}
+
+void assembly_t::add_packed_contig(const contig_t contig, string& packed_bases, vector<sequence_run_t>& runs, const string::size_type base_count) {
+	string& contig_packed_bases = this->packed_bases[contig];
+	vector<sequence_run_t>& contig_runs = this->runs[contig];
+	contig_packed_bases.swap(packed_bases);
+	contig_runs.swap(runs);
+	(*this)[contig] = contig_sequence_t((const uint8_t*) contig_packed_bases.data(), base_count, contig_runs.data(), contig_runs.size());
+}
+
+void assembly_t::add_mapped_contig(const contig_t contig, const uint8_t* packed_bases, const string::size_type base_count, const sequence_run_t* runs, const uint32_t run_count) {
+	(*this)[contig] = contig_sequence_t(packed_bases, base_count, runs, run_count);
+}
+
+void assembly_t::map_cache_file(void* mapped_cache_file, const size_t mapped_cache_file_size) {
+	this->mapped_cache_file = mapped_cache_file;
+	this->mapped_cache_file_size = mapped_cache_file_size;
+}
+
+void assembly_t::add_lazy_contig(const contig_t contig, const lazy_contig_t* lazy_contig, const string::size_type base_count) {
+	(*this)[contig] = contig_sequence_t(lazy_contig, base_count);
+}
+
+void assembly_t::open_lazy_fasta_file(lazy_fasta_file_t* lazy_fasta_file) {
+	this->lazy_fasta_file = lazy_fasta_file;
+}
+
+// layout of the assembly cache file:
+// header, directory of contigs, names of contigs and for every contig the packed bases followed by the runs of non-ACGT characters
+// all sections start at offsets which are a multiple of 8, so that they can be accessed directly in the mapped file
+const char ASSEMBLY_CACHE_MAGIC[8] = { 'A', 'R', 'B', 'A', '2', 'B', 'I', 'T' };
+struct assembly_cache_header_t {
+	char magic[8];
+	uint64_t contig_count;
+};
+struct assembly_cache_contig_t {
+	uint64_t name_offset;
+	uint64_t name_length;
+	uint64_t has_sequence; // contigs without sequence are only listed to preserve the contig IDs
+	uint64_t base_count;
+	uint64_t packed_bases_offset;
+	uint64_t runs_offset;
+	uint64_t run_count;
+};
+
+uint64_t align_cache_offset(const uint64_t offset) {
+	return (offset + 7) / 8 * 8;
+}
+
+bool is_assembly_cache(const string& file_path) {
+	FILE* file = fopen(file_path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	char magic[sizeof(ASSEMBLY_CACHE_MAGIC)];
+	bool result = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, ASSEMBLY_CACHE_MAGIC, sizeof(magic)) == 0;
+	fclose(file);
+	return result;
+}
+
+void write_assembly_cache(const assembly_t& assembly, const vector<string>& original_contig_names, const string& cache_file_path) {
+
+	// compute the offsets of all sections
+	vector<assembly_cache_contig_t> directory(original_contig_names.size());
+	uint64_t offset = sizeof(assembly_cache_header_t) + directory.size() * sizeof(assembly_cache_contig_t);
+	for (contig_t contig = 0; contig < directory.size(); ++contig) {
+		directory[contig].name_offset = offset;
+		directory[contig].name_length = original_contig_names[contig].size();
+		offset += original_contig_names[contig].size();
+	}
+	for (contig_t contig = 0; contig < directory.size(); ++contig) {
+		assembly_t::const_iterator contig_sequence = assembly.find(contig);
+		directory[contig].has_sequence = contig_sequence != assembly.end();
+		directory[contig].base_count = (directory[contig].has_sequence) ? contig_sequence->second.size() : 0;
+		directory[contig].run_count = (directory[contig].has_sequence) ? contig_sequence->second.get_run_count() : 0;
+		directory[contig].packed_bases_offset = offset = align_cache_offset(offset);
+		offset += (directory[contig].base_count + 3) / 4;
+		directory[contig].runs_offset = offset = align_cache_offset(offset);
+		offset += directory[contig].run_count * sizeof(sequence_run_t);
+	}
+
+	// write the sections
+	FILE* cache_file = fopen(cache_file_path.c_str(), "wb");
+	crash(cache_file == NULL, "failed to open file: " + cache_file_path);
+	assembly_cache_header_t header;
+	memcpy(header.magic, ASSEMBLY_CACHE_MAGIC, sizeof(header.magic));
+	header.contig_count = directory.size();
+	bool success = fwrite(&header, sizeof(header), 1, cache_file) == 1;
+	if (!directory.empty())
+		success = success && fwrite(&directory[0], sizeof(assembly_cache_contig_t), directory.size(), cache_file) == directory.size();
+	for (contig_t contig = 0; contig < directory.size(); ++contig)
+		success = success && fwrite(original_contig_names[contig].data(), 1, directory[contig].name_length, cache_file) == directory[contig].name_length;
+	offset = directory.empty() ? 0 : directory.back().name_offset + directory.back().name_length;
+	const char padding[8] = {0,0,0,0,0,0,0,0};
+	for (contig_t contig = 0; contig < directory.size(); ++contig) {
+		success = success && fwrite(padding, 1, directory[contig].packed_bases_offset - offset, cache_file) == directory[contig].packed_bases_offset - offset;
+		offset = directory[contig].packed_bases_offset + (directory[contig].base_count + 3) / 4;
+		if (directory[contig].has_sequence)
+			success = success && fwrite(assembly.at(contig).get_packed_bases(), 1, offset - directory[contig].packed_bases_offset, cache_file) == offset - directory[contig].packed_bases_offset;
+		success = success && fwrite(padding, 1, directory[contig].runs_offset - offset, cache_file) == directory[contig].runs_offset - offset;
+		offset = directory[contig].runs_offset + directory[contig].run_count * sizeof(sequence_run_t);
+		if (directory[contig].run_count > 0)
+			success = success && fwrite(assembly.at(contig).get_runs(), sizeof(sequence_run_t), directory[contig].run_count, cache_file) == directory[contig].run_count;
+	}
+	crash(fclose(cache_file) != 0 || !success, "failed to write file: " + cache_file_path);
+}
+
+// map the assembly cache file into memory, so that loading is instantaneous and the pages can be shared by multiple processes
+void load_assembly_cache(assembly_t& assembly, const string& cache_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs) {
+
+	int file_descriptor = open(cache_file_path.c_str(), O_RDONLY);
+	crash(file_descriptor < 0, "failed to open file: " + cache_file_path);
+	struct stat file_status;
+	crash(fstat(file_descriptor, &file_status) != 0, "failed to open file: " + cache_file_path);
+	const size_t file_size = file_status.st_size;
+	crash(file_size < sizeof(assembly_cache_header_t), "malformed assembly cache: " + cache_file_path);
+	void* mapped_file = mmap(NULL, file_size, PROT_READ, MAP_SHARED, file_descriptor, 0);
+	close(file_descriptor);
+	crash(mapped_file == MAP_FAILED, "failed to map file into memory: " + cache_file_path);
+	assembly.map_cache_file(mapped_file, file_size);
+	const char* cache = (const char*) mapped_file;
+
+	const assembly_cache_header_t* header = (const assembly_cache_header_t*) cache;
+	crash(header->contig_count > USHRT_MAX - 1, "too many contigs");
+	crash(sizeof(assembly_cache_header_t) + header->contig_count * sizeof(assembly_cache_contig_t) > file_size, "malformed assembly cache: " + cache_file_path);
+	const assembly_cache_contig_t* directory = (const assembly_cache_contig_t*) (cache + sizeof(assembly_cache_header_t));
+	for (uint64_t i = 0; i < header->contig_count; ++i) {
+		crash(directory[i].name_offset + directory[i].name_length > file_size ||
+		      directory[i].packed_bases_offset + (directory[i].base_count + 3) / 4 > file_size ||
+		      directory[i].runs_offset + directory[i].run_count * sizeof(sequence_run_t) > file_size, "malformed assembly cache: " + cache_file_path);
+
+		// register contig name like when reading a FastA file
+		string contig_name(cache + directory[i].name_offset, directory[i].name_length);
+		pair<contigs_t::iterator,bool> new_contig = contigs.insert(pair<string,contig_t>(removeChr(contig_name), contigs.size()));
+		contig_t contig = new_contig.first->second;
+		if (original_contig_names.size() < contigs.size())
+			original_contig_names.resize(contigs.size());
+		original_contig_names[contig] = contig_name;
+
+		if (directory[i].has_sequence && is_interesting_contig(contig_name, interesting_contigs))
+			assembly.add_mapped_contig(contig, (const uint8_t*) cache + directory[i].packed_bases_offset, directory[i].base_count, (const sequence_run_t*) (cache + directory[i].runs_offset), directory[i].run_count);
+	}
+}
+
+// register the contigs listed in the index of the FastA file, but only fetch the sequences when they are accessed
+// this saves memory, when only a small part of the assembly is needed, e.g., for targeted sequencing
+void load_assembly_lazily(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs) {
+	lazy_fasta_file_t* lazy_fasta_file = new lazy_fasta_file_t(fasta_file_path);
+	assembly.open_lazy_fasta_file(lazy_fasta_file);
+	for (int i = 0; i < faidx_nseq(lazy_fasta_file->fasta_index); ++i) {
+		crash(contigs.size() == USHRT_MAX - 1, "too many contigs");
+		string contig_name = faidx_iseq(lazy_fasta_file->fasta_index, i);
+		pair<contigs_t::iterator,bool> new_contig = contigs.insert(pair<string,contig_t>(removeChr(contig_name), contigs.size()));
+		contig_t contig = new_contig.first->second;
+		if (original_contig_names.size() < contigs.size())
+			original_contig_names.resize(contigs.size());
+		original_contig_names[contig] = contig_name;
+
+		hts_pos_t contig_length = faidx_seq_len64(lazy_fasta_file->fasta_index, contig_name.c_str());
+		if (contig_length > 0 && is_interesting_contig(contig_name, interesting_contigs)) {
+			lazy_fasta_file->contigs.push_back(new lazy_contig_t(lazy_fasta_file, contig_name, contig_length));
+			assembly.add_lazy_contig(contig, lazy_fasta_file->contigs.back(), contig_length);
+		}
+	}
+}
+
+// the sequence of a contig is given by one or more regions of the FastA file,
+// since a contig may be listed multiple times, in which case the sequences are concatenated
+struct fasta_contig_t {
+	contig_t contig;
+	vector< pair<const char*,const char*> > regions; // sequence lines including line breaks
+	string packed_bases;
+	vector<sequence_run_t> runs;
+	string::size_type base_count;
+};
+
+class assembly_loader_t {
+	public:
+		assembly_loader_t(assembly_t& assembly): assembly(assembly), fasta_file(NULL) { next_contig = 0; };
+		~assembly_loader_t() { delete fasta_file; };
+		assembly_t& assembly;
+		file_content_t* fasta_file;
+		vector<fasta_contig_t> fasta_contigs;
+		atomic<unsigned int> next_contig; // the worker threads take one contig at a time
+		vector<thread> workers;
+};
+
+void pack_fasta_contigs(assembly_loader_t* assembly_loader) {
+	for (unsigned int i = assembly_loader->next_contig++; i < assembly_loader->fasta_contigs.size(); i = assembly_loader->next_contig++) {
+		fasta_contig_t& fasta_contig = assembly_loader->fasta_contigs[i];
+		string::size_type region_size = 0;
+		for (vector< pair<const char*,const char*> >::iterator region = fasta_contig.regions.begin(); region != fasta_contig.regions.end(); ++region)
+			region_size += region->second - region->first;
+		fasta_contig.packed_bases.reserve((region_size + 3) / 4); // slightly more than needed due to line breaks
+		sequence_packer_t sequence_packer(fasta_contig.packed_bases, fasta_contig.runs);
+		for (vector< pair<const char*,const char*> >::iterator region = fasta_contig.regions.begin(); region != fasta_contig.regions.end(); ++region)
+			for (const char* base = region->first; base != region->second; ++base)
+				if (*base != '\n' && *base != '\r') // skip line breaks (including DOS line breaks)
+					sequence_packer.append(toupper(*base)); // convert sequence to uppercase
+		fasta_contig.base_count = sequence_packer.base_count;
+	}
+}
+
+// find the next line which starts with '>'
+const char* find_next_fasta_header(const char* fasta_file, const char* position, const char* fasta_file_end) {
+	while (position < fasta_file_end) {
+		const char* header = (const char*) memchr(position, '>', fasta_file_end - position);
+		if (header == NULL)
+			break;
+		if (header == fasta_file || header[-1] == '\n')
+			return header;
+		position = header + 1;
+	}
+	return fasta_file_end;
+}
+
+// find the headers of all contigs in the FastA file, the sequences are then packed by worker threads
+void start_loading_fasta_file(assembly_loader_t* assembly_loader, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const unsigned int threads) {
+
+	// load the complete file into memory
+	assembly_loader->fasta_file = new file_content_t(fasta_file_path);
+	const char* fasta_file = assembly_loader->fasta_file->data();
+	const size_t fasta_file_size = assembly_loader->fasta_file->size();
+	const char* fasta_file_end = fasta_file + fasta_file_size;
+
+	// sequence lines never contain '>', so the headers can be found quickly without scanning the file line by line
+	// contigs are registered in the order in which they appear in the file to preserve the contig IDs
+	unordered_map<contig_t,unsigned int> fasta_contig_by_contig;
+	for (const char* header = find_next_fasta_header(fasta_file, fasta_file, fasta_file_end); header != fasta_file_end;) {
+		const char* header_end = (const char*) memchr(header, '\n', fasta_file_end - header);
+		if (header_end == NULL)
+			header_end = fasta_file_end;
+		const char* next_header = find_next_fasta_header(fasta_file, header_end, fasta_file_end);
+
+		// get contig name
+		crash(contigs.size() == USHRT_MAX - 1, "too many contigs");
+		istringstream iss(string(header + 1, header_end));
+		string contig_name;
+		iss >> contig_name;
+		pair<contigs_t::iterator,bool> new_contig = contigs.insert(pair<string,contig_t>(removeChr(contig_name), contigs.size()));
+		contig_t contig = new_contig.first->second;
+		if (original_contig_names.size() < contigs.size())
+			original_contig_names.resize(contigs.size());
+		original_contig_names[contig] = contig_name;
+
+		// remember where to find the sequence (skip uninteresting contigs)
+		if (is_interesting_contig(contig_name, interesting_contigs)) {
+			pair<unordered_map<contig_t,unsigned int>::iterator,bool> fasta_contig = fasta_contig_by_contig.insert(pair<contig_t,unsigned int>(contig, assembly_loader->fasta_contigs.size()));
+			if (fasta_contig.second) { // contig has not been listed before
+				assembly_loader->fasta_contigs.resize(assembly_loader->fasta_contigs.size() + 1);
+				assembly_loader->fasta_contigs.back().contig = contig;
+				assembly_loader->fasta_contigs.back().base_count = 0;
 			}
+			assembly_loader->fasta_contigs[fasta_contig.first->second].regions.push_back(make_pair(header_end, next_header));
 		}
+
+		header = next_header;
 	}
+
+	// pack the sequences in the background
+	for (unsigned int worker = 0; worker < threads && worker < assembly_loader->fasta_contigs.size(); ++worker)
+		assembly_loader->workers.push_back(std::thread(pack_fasta_contigs, assembly_loader));
 }
 
+assembly_loader_t* start_loading_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const bool lazy, const unsigned int threads) {
+
+	assembly_loader_t* assembly_loader = new assembly_loader_t(assembly);
+
+	if (is_assembly_cache(fasta_file_path)) { // the assembly may also be given as a cache file
+		crash(lazy, "an assembly cache file cannot be loaded lazily");
+		load_assembly_cache(assembly, fasta_file_path, contigs, original_contig_names, interesting_contigs);
+	} else if (lazy) {
+		load_assembly_lazily(assembly, fasta_file_path, contigs, original_contig_names, interesting_contigs);
+	} else {
+		start_loading_fasta_file(assembly_loader, fasta_file_path, contigs, original_contig_names, interesting_contigs, threads);
+	}
+
+	return assembly_loader;
+}
+
+void finish_loading_assembly(assembly_loader_t* assembly_loader) {
+
+	for (vector<thread>::iterator worker = assembly_loader->workers.begin(); worker != assembly_loader->workers.end(); ++worker)
+		worker->join();
+
+	for (vector<fasta_contig_t>::iterator fasta_contig = assembly_loader->fasta_contigs.begin(); fasta_contig != assembly_loader->fasta_contigs.end(); ++fasta_contig)
+		if (fasta_contig->base_count > 0)
+			assembly_loader->assembly.add_packed_contig(fasta_contig->contig, fasta_contig->packed_bases, fasta_contig->runs, fasta_contig->base_count);
+
+	delete assembly_loader;
+}
+
+void load_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const bool lazy, const unsigned int threads) {
+	finish_loading_assembly(start_loading_assembly(assembly, fasta_file_path, contigs, original_contig_names, interesting_contigs, lazy, threads));
+}
@@ -24,6 +24,20 @@ void dna_to_reverse_complement(const string& dna, string& reverse_complement);
 
 string dna_to_reverse_complement(const string& dna);
 
-void load_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs);
+class assembly_loader_t;
+
+// load a FastA file or an assembly cache file
+// when <lazy> is set, the sequences are fetched from the indexed FastA file on demand
+// start_loading_assembly() returns as soon as all contigs have been registered, the sequences of a FastA file
+// are then parsed by <threads> threads in the background until finish_loading_assembly() is called
+assembly_loader_t* start_loading_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const bool lazy, const unsigned int threads);
+void finish_loading_assembly(assembly_loader_t* assembly_loader);
+void load_assembly(assembly_t& assembly, const string& fasta_file_path, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const bool lazy, const unsigned int threads);
+
+// returns true, if the file is an assembly cache file rather than a FastA file
+bool is_assembly_cache(const string& file_path);
+
+// write the assembly in 2-bit encoding to a file, which can be mapped into memory by load_assembly()
+void write_assembly_cache(const assembly_t& assembly, const vector<string>& original_contig_names, const string& cache_file_path);
 
 #endif /* ASSEMBLY_H */
@@ -5,15 +5,25 @@
 #include <climits>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iterator>
 #include <list>
 #include <map>
 #include <set>
 #include <string>
 #include <sstream>
+#include <stdexcept>
 #include <tuple>
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 #include "sam.h"
 
 using namespace std;
@@ -109,7 +119,118 @@ inline bool is_interesting_contig(string contig, const string& interesting_conti
 	return false;
 };
 
-typedef unordered_map<contig_t,string> assembly_t;
+// characters of the assembly other than A, C, G and T (mostly N) are stored as runs of identical characters
+// the layout must not change, because the runs are mapped into memory from the assembly cache file
+struct sequence_run_t {
+	uint32_t start;
+	uint32_t end; // exclusive
+	char base;
+	char padding[3];
+};
+
+class lazy_contig_t; // contig whose sequence is fetched from an indexed FastA file on demand (see assembly.cpp)
+class lazy_fasta_file_t;
+
+// contig sequences are stored in 2-bit encoding (four bases per byte, the first base in the lowest two bits)
+// the memory is not owned by the contig, but by assembly_t, which either holds the sequences loaded from a FastA file
+// or maps the assembly cache file into memory or fetches the sequences on demand
+class contig_sequence_t {
+	private:
+		const uint8_t* packed_bases;
+		const sequence_run_t* runs; // sorted by position
+		uint32_t run_count;
+		string::size_type base_count;
+		const lazy_contig_t* lazy_contig; // only set, if the sequence is fetched on demand
+		char get_lazy_base(const string::size_type position) const;
+		string get_lazy_substr(const string::size_type position, const string::size_type length) const;
+		static bool starts_after(const uint32_t position, const sequence_run_t& run) { return position < run.start; };
+		static bool ends_before(const sequence_run_t& run, const uint32_t position) { return run.end <= position; };
+	public:
+		contig_sequence_t(): packed_bases(NULL), runs(NULL), run_count(0), base_count(0), lazy_contig(NULL) {};
+		contig_sequence_t(const uint8_t* packed_bases, const string::size_type base_count, const sequence_run_t* runs, const uint32_t run_count):
+			packed_bases(packed_bases), runs(runs), run_count(run_count), base_count(base_count), lazy_contig(NULL) {};
+		contig_sequence_t(const lazy_contig_t* lazy_contig, const string::size_type base_count):
+			packed_bases(NULL), runs(NULL), run_count(0), base_count(base_count), lazy_contig(lazy_contig) {};
+		string::size_type size() const { return base_count; };
+		string::size_type length() const { return base_count; };
+		bool empty() const { return base_count == 0; };
+		const uint8_t* get_packed_bases() const { return packed_bases; };
+		const sequence_run_t* get_runs() const { return runs; };
+		uint32_t get_run_count() const { return run_count; };
+		char operator[](const string::size_type position) const {
+			if (lazy_contig != NULL)
+				return get_lazy_base(position);
+			if (run_count > 0) { // look for the last run which starts at or before <position>
+				const sequence_run_t* run = upper_bound(runs, runs + run_count, (uint32_t) position, starts_after);
+				if (run != runs && position < (--run)->end)
+					return run->base;
+			}
+			return "ACGT"[(packed_bases[position/4] >> ((position % 4) * 2)) & 3];
+		};
+		string substr(const string::size_type position, string::size_type length = string::npos) const {
+			if (position > base_count)
+				throw out_of_range("contig_sequence_t::substr");
+			length = min(length, base_count - position);
+			if (lazy_contig != NULL)
+				return get_lazy_substr(position, length);
+			string result(length, 'N');
+			for (string::size_type i = 0; i < length; ++i)
+				result[i] = "ACGT"[(packed_bases[(position+i)/4] >> (((position+i) % 4) * 2)) & 3];
+			// overwrite the bases which are not A, C, G or T
+			for (const sequence_run_t* run = lower_bound(runs, runs + run_count, (uint32_t) position, ends_before); run != runs + run_count && run->start < position + length; ++run)
+				for (string::size_type i = max((string::size_type) run->start, position); i < min((string::size_type) run->end, position + length); ++i)
+					result[i - position] = run->base;
+			return result;
+		};
+		// returns true, if the contig matches the given bases at <position>
+		// the bases are compared in place and the runs are walked alongside the position, such that the comparison stops at the first mismatch
+		bool matches(const string::size_type position, const char* bases, const string::size_type length) const {
+			if (position > base_count || length > base_count - position)
+				return false;
+			if (lazy_contig != NULL) {
+				for (string::size_type i = 0; i < length; ++i)
+					if (get_lazy_base(position + i) != bases[i])
+						return false;
+				return true;
+			}
+			const sequence_run_t* run = lower_bound(runs, runs + run_count, (uint32_t) position, ends_before);
+			for (string::size_type i = position; i < position + length; ++i) {
+				if (run != runs + run_count && run->end <= i)
+					++run; // runs are neither empty nor overlapping => the next run cannot end before <i>
+				const char base = (run != runs + run_count && run->start <= i) ? run->base : "ACGT"[(packed_bases[i/4] >> ((i % 4) * 2)) & 3];
+				if (base != bases[i - position])
+					return false;
+			}
+			return true;
+		};
+};
+
+// sequences of all (interesting) contigs
+// the storage of the sequences is owned by the assembly, so it must not be copied
+class assembly_t: public unordered_map<contig_t,contig_sequence_t> {
+	public:
+		assembly_t(): mapped_cache_file(NULL), mapped_cache_file_size(0), lazy_fasta_file(NULL) {};
+		~assembly_t();
+		// pack a sequence into 2-bit encoding and keep it in memory
+		void add_contig(const contig_t contig, const string& sequence);
+		// take over a sequence, which has already been packed (the arguments are swapped with empty containers)
+		void add_packed_contig(const contig_t contig, string& packed_bases, vector<sequence_run_t>& runs, const string::size_type base_count);
+		// use a sequence which is stored in the mapped cache file
+		void add_mapped_contig(const contig_t contig, const uint8_t* packed_bases, const string::size_type base_count, const sequence_run_t* runs, const uint32_t run_count);
+		// the mapping is released, when the assembly is destroyed
+		void map_cache_file(void* mapped_cache_file, const size_t mapped_cache_file_size);
+		// fetch sequences on demand from an indexed FastA file, which is closed, when the assembly is destroyed
+		void add_lazy_contig(const contig_t contig, const lazy_contig_t* lazy_contig, const string::size_type base_count);
+		void open_lazy_fasta_file(lazy_fasta_file_t* lazy_fasta_file);
+	private:
+		assembly_t(const assembly_t&);
+		assembly_t& operator=(const assembly_t&);
+		unordered_map<contig_t,string> packed_bases;
+		unordered_map<contig_t, vector<sequence_run_t> > runs;
+		void* mapped_cache_file;
+		size_t mapped_cache_file_size;
+		lazy_fasta_file_t* lazy_fasta_file;
+};
 
 struct annotation_record_t {
 	contig_t contig;
@@ -134,28 +255,202 @@ template <class T> class annotation_set_t: public vector<T> {
 			else
 				return existing_element;
 		};
-		void insert(typename annotation_set_t<T>::const_iterator first, typename annotation_set_t<T>::const_iterator last) {
+		template <class I> void insert(I first, I last) {
 			this->reserve(this->size() + distance(first, last));
 			for (auto annotation_record = first; annotation_record != last; ++annotation_record)
 				this->insert(*annotation_record);
 		};
 		using vector<T>::insert;
 };
-template <class T> class annotation_t: public list<T> {};
-template <class T> class contig_annotation_index_t: public map< position_t, annotation_set_t<T> > {};
+// strings which live as long as the arena, they are copied into large blocks of memory rather than being allocated one by one
+const size_t STRING_ARENA_BLOCK_SIZE = 1024*1024;
+class string_arena_t {
+	public:
+		string_arena_t(): free_bytes(0) {};
+		const char* add(const char* s, const size_t length) {
+			if (free_bytes < length + 1) { // the string does not fit into the current block => allocate a new one
+				blocks.push_back(vector<char>(max(STRING_ARENA_BLOCK_SIZE, length + 1)));
+				free_bytes = blocks.back().size();
+			}
+			char* result = &blocks.back()[blocks.back().size() - free_bytes];
+			memcpy(result, s, length);
+			result[length] = '\0';
+			free_bytes -= length + 1;
+			return result;
+		};
+		const char* add(const string& s) { return add(s.c_str(), s.size()); };
+		void clear() { blocks.clear(); free_bytes = 0; };
+	private:
+		string_arena_t(const string_arena_t&);
+		string_arena_t& operator=(const string_arena_t&);
+		deque< vector<char> > blocks; // blocks are never reallocated, so the strings never move
+		size_t free_bytes;
+};
+template <class A, class T> class annotation_iterator_t {
+	public:
+		typedef forward_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef ptrdiff_t difference_type;
+		typedef T* pointer;
+		typedef T& reference;
+		annotation_iterator_t(A* annotation, size_t index): annotation(annotation), index(index) {};
+		template <class A2, class T2> annotation_iterator_t(const annotation_iterator_t<A2,T2>& x): annotation(x.annotation), index(x.index) {}; // iterator -> const_iterator
+		T& operator*() const { return (*annotation)[index]; };
+		T* operator->() const { return &(*annotation)[index]; };
+		annotation_iterator_t& operator++() { index = annotation->next_index(index); return *this; };
+		annotation_iterator_t operator++(int) { annotation_iterator_t result = *this; ++(*this); return result; };
+		bool operator==(const annotation_iterator_t& x) const { return index == x.index; };
+		bool operator!=(const annotation_iterator_t& x) const { return index != x.index; };
+		A* annotation;
+		size_t index;
+};
+// features are stored in contiguous blocks, which are never reallocated, such that pointers to features remain valid,
+// when more features are added; erased features are merely flagged and skipped during iteration for the same reason
+// the names of the features are kept in a shared arena
+template <class T> class annotation_t {
+	public:
+		typedef annotation_iterator_t<annotation_t<T>,T> iterator;
+		typedef annotation_iterator_t<const annotation_t<T>,const T> const_iterator;
+		annotation_t(): erased_count(0) {};
+		iterator begin() { return iterator(this, first_index()); };
+		iterator end() { return iterator(this, erased.size()); };
+		const_iterator begin() const { return const_iterator(this, first_index()); };
+		const_iterator end() const { return const_iterator(this, erased.size()); };
+		size_t size() const { return erased.size() - erased_count; };
+		bool empty() const { return size() == 0; };
+		T& back() { return (*this)[erased.size() - 1]; };
+		void push_back(const T& feature) {
+			if (blocks.empty() || blocks.back().size() == BLOCK_SIZE) {
+				blocks.push_back(vector<T>());
+				blocks.back().reserve(BLOCK_SIZE);
+			}
+			blocks.back().push_back(feature);
+			erased.push_back(false);
+		};
+		iterator erase(iterator feature) {
+			erased[feature.index] = true;
+			erased_count++;
+			return ++feature;
+		};
+		void clear() { blocks.clear(); erased.clear(); erased_count = 0; strings.clear(); };
+		// features are addressed by a stable index, which includes erased features
+		T& operator[](const size_t index) { return blocks[index / BLOCK_SIZE][index % BLOCK_SIZE]; };
+		const T& operator[](const size_t index) const { return blocks[index / BLOCK_SIZE][index % BLOCK_SIZE]; };
+		size_t next_index(size_t index) const {
+			do { ++index; } while (index < erased.size() && erased[index]);
+			return index;
+		};
+		string_arena_t strings;
+	private:
+		annotation_t(const annotation_t&);
+		annotation_t& operator=(const annotation_t&);
+		static const size_t BLOCK_SIZE = 4096;
+		size_t first_index() const { return (!erased.empty() && erased[0]) ? next_index(0) : 0; };
+		deque< vector<T> > blocks;
+		vector<bool> erased;
+		size_t erased_count;
+};
+// read-only view of the features of a region in the pool of an index
+template <class T> class annotation_span_t {
+	public:
+		typedef const T* iterator;
+		typedef const T* const_iterator;
+		annotation_span_t(): first(NULL), last(NULL) {};
+		annotation_span_t(const T* first, const T* last): first(first), last(last) {};
+		annotation_span_t(const vector<T>& features): first(features.data()), last(features.data() + features.size()) {};
+		const_iterator begin() const { return first; };
+		const_iterator end() const { return last; };
+		size_t size() const { return last - first; };
+		bool empty() const { return first == last; };
+		const T& operator[](const size_t index) const { return first[index]; };
+	private:
+		const T* first;
+		const T* last;
+};
+template <class T> struct annotation_index_entry_t {
+	position_t first; // last position of the region
+	annotation_span_t<T> second; // features overlapping the region (sorted)
+};
+// the regions of a contig are stored in an array sorted by position,
+// the features overlapping the regions are stored consecutively in one shared pool
+template <class T> class contig_annotation_index_t: public vector< annotation_index_entry_t<T> > {
+	public:
+		contig_annotation_index_t() {};
+		contig_annotation_index_t(const contig_annotation_index_t& x) { *this = x; };
+		contig_annotation_index_t& operator=(const contig_annotation_index_t& x) {
+			vector< annotation_index_entry_t<T> >::operator=(x);
+			pool = x.pool;
+			for (typename contig_annotation_index_t::iterator entry = this->begin(); entry != this->end(); ++entry) // point to own pool
+				entry->second = annotation_span_t<T>(pool.data() + (entry->second.begin() - x.pool.data()), pool.data() + (entry->second.end() - x.pool.data()));
+			return *this;
+		};
+		// the features of region i are given by pool[offsets[i]] .. pool[offsets[i+1]-1]
+		void assign(const vector<position_t>& boundaries, const vector<unsigned int>& offsets, vector<T>& features) {
+			pool.swap(features);
+			this->resize(boundaries.size());
+			for (size_t i = 0; i < boundaries.size(); ++i) {
+				(*this)[i].first = boundaries[i];
+				(*this)[i].second = annotation_span_t<T>(pool.data() + offsets[i], pool.data() + offsets[i+1]);
+			}
+		};
+		void clear() { vector< annotation_index_entry_t<T> >::clear(); pool.clear(); };
+		// find the region containing the given position
+		typename contig_annotation_index_t::const_iterator lower_bound(const position_t position) const { return std::lower_bound(this->begin(), this->end(), position, ends_before); };
+		typename contig_annotation_index_t::iterator lower_bound(const position_t position) { return std::lower_bound(this->begin(), this->end(), position, ends_before); };
+	private:
+		static bool ends_before(const annotation_index_entry_t<T>& entry, const position_t position) { return entry.first < position; };
+		vector<T> pool;
+};
 template <class T> class annotation_index_t: public vector< contig_annotation_index_t<T> > {};
 
 struct gene_annotation_record_t: public annotation_record_t {
 	unsigned int id; // ID used internally
-	string gene_id; // ID specified in the GTF file
-	string name;
+	const char* gene_id; // ID specified in the GTF file (stored in the string arena of the annotation)
+	const char* name;
 	int exonic_length; // sum of the length of all exons in a gene
 	bool is_dummy;
 	bool is_protein_coding;
+	vector<position_t> spliced_breakpoints[2]; // sorted positions which are considered spliced, indexed by direction (see make_splice_site_index())
+	vector<position_t> downstream_splice_sites; // sorted boundaries of the regions of the exon index which are spliced in downstream direction
 };
 typedef gene_annotation_record_t* gene_t;
 typedef annotation_set_t<gene_t> gene_set_t;
 typedef annotation_t<gene_annotation_record_t> gene_annotation_t;
+// most alignments are annotated with one of a small number of distinct gene sets
+// => every distinct gene set is stored only once in a pool and alignments only hold the ID of the gene set
+// the pool is not thread-safe, gene sets must be interned by one thread at a time
+class gene_set_pool_t {
+	private:
+		map<gene_set_t,unsigned int> ids;
+		vector<const gene_set_t*> gene_sets; // points to the keys of <ids>
+	public:
+		gene_set_pool_t() { intern(gene_set_t()); }; // the empty set has the ID 0
+		unsigned int intern(const gene_set_t& genes) {
+			pair<map<gene_set_t,unsigned int>::iterator,bool> id = ids.insert(make_pair(genes, gene_sets.size()));
+			if (id.second) // gene set was not in the pool yet
+				gene_sets.push_back(&id.first->first);
+			return id.first->second;
+		};
+		const gene_set_t& get(const unsigned int id) const { return *gene_sets[id]; };
+};
+inline gene_set_pool_t& get_gene_set_pool() { static gene_set_pool_t gene_set_pool; return gene_set_pool; }
+// immutable handle to a gene set in the pool
+class interned_gene_set_t {
+	private:
+		uint32_t id;
+	public:
+		interned_gene_set_t(): id(0) {};
+		interned_gene_set_t& operator=(const gene_set_t& genes) { id = get_gene_set_pool().intern(genes); return *this; };
+		const gene_set_t& get() const { return get_gene_set_pool().get(id); };
+		operator const gene_set_t&() const { return get(); };
+		gene_set_t::const_iterator begin() const { return get().begin(); };
+		gene_set_t::const_iterator end() const { return get().end(); };
+		gene_t operator[](const unsigned int index) const { return get()[index]; };
+		size_t size() const { return get().size(); };
+		bool empty() const { return id == 0; };
+		void clear() { id = 0; };
+};
+typedef annotation_span_t<gene_t> gene_span_t;
 typedef contig_annotation_index_t<gene_t> gene_contig_annotation_index_t;
 typedef annotation_index_t<gene_t> gene_annotation_index_t;
 
@@ -163,7 +458,7 @@ struct exon_annotation_record_t;
 typedef exon_annotation_record_t* exon_t;
 struct transcript_annotation_record_t {
 	unsigned int id;
-	string name;
+	const char* name; // stored in the string arena of the annotation
 	exon_t first_exon;
 	exon_t last_exon;
 };
@@ -178,6 +473,7 @@ struct exon_annotation_record_t: public annotation_record_t {
 };
 typedef annotation_set_t<exon_t> exon_set_t;
 typedef annotation_t<exon_annotation_record_t> exon_annotation_t;
+typedef annotation_span_t<exon_t> exon_span_t;
 typedef contig_annotation_index_t<exon_t> exon_contig_annotation_index_t;
 typedef annotation_index_t<exon_t> exon_annotation_index_t;
 
@@ -187,6 +483,86 @@ class cigar_t: public vector<uint32_t> {
 		uint32_t op_length(unsigned int index) const { return bam_cigar_oplen(this->at(index)); };
 };
 
+// convert <length> bases starting at <position> from the 4-bit encoding of BAM records to ASCII
+// with SSE2, 16 bases are decoded at a time (the lookup is done with a single shuffle, if SSSE3 is available)
+inline void decode_nt16_sequence(const uint8_t* packed_bases, const unsigned int position, const unsigned int length, char* decoded) {
+	unsigned int i = 0;
+	if (position % 2 == 1 && length > 0) // the vectorized loop needs to start at the high nibble of a byte
+		decoded[i++] = seq_nt16_str[bam_seqi(packed_bases, position)];
+#ifdef __SSE2__
+	const __m128i low_nibble_mask = _mm_set1_epi8(0x0F);
+#ifdef __SSSE3__
+	const __m128i lookup_table = _mm_loadu_si128((const __m128i*) seq_nt16_str);
+#endif
+	for (; i + 16 <= length; i += 16) {
+		__m128i packed = _mm_loadl_epi64((const __m128i*) (packed_bases + (position + i) / 2));
+		__m128i high_nibbles = _mm_and_si128(_mm_srli_epi16(packed, 4), low_nibble_mask);
+		__m128i low_nibbles = _mm_and_si128(packed, low_nibble_mask);
+		__m128i codes = _mm_unpacklo_epi8(high_nibbles, low_nibbles); // the high nibble holds the first base of a pair
+#ifdef __SSSE3__
+		__m128i bases = _mm_shuffle_epi8(lookup_table, codes);
+#else
+		__m128i bases = _mm_setzero_si128();
+		for (int code = 0; code < 16; ++code)
+			bases = _mm_or_si128(bases, _mm_and_si128(_mm_cmpeq_epi8(codes, _mm_set1_epi8(code)), _mm_set1_epi8(seq_nt16_str[code])));
+#endif
+		_mm_storeu_si128((__m128i*) (decoded + i), bases);
+	}
+#endif
+	for (; i < length; ++i)
+		decoded[i] = seq_nt16_str[bam_seqi(packed_bases, position + i)];
+}
+
+// read sequences are kept in the 4-bit encoding of BAM records (two bases per byte),
+// which takes half the memory of a string and can be copied from BAM records without decoding
+class packed_sequence_t {
+	private:
+		string packed_bases; // the first base of every pair is stored in the high nibble like in BAM records
+		unsigned int base_count;
+		static uint8_t complement_base(const uint8_t base) { // complementing a base in 4-bit encoding means reversing the bits (A=1,C=2,G=4,T=8)
+			return ((base & 1) << 3) | ((base & 2) << 1) | ((base & 4) >> 1) | ((base & 8) >> 3);
+		};
+		void set_base(const unsigned int position, const uint8_t base) {
+			packed_bases[position/2] = (position % 2 == 0) ? ((packed_bases[position/2] & 0x0F) | (base << 4)) : ((packed_bases[position/2] & 0xF0) | base);
+		};
+	public:
+		packed_sequence_t(): base_count(0) {};
+		void assign(const uint8_t* bam_sequence, const unsigned int length) { // copy sequence from a BAM record
+			packed_bases.assign((const char*) bam_sequence, (length + 1) / 2);
+			base_count = length;
+		};
+		void assign(const string& sequence) {
+			base_count = sequence.size();
+			packed_bases.assign((base_count + 1) / 2, 0);
+			for (unsigned int i = 0; i < base_count; ++i)
+				set_base(i, seq_nt16_table[(unsigned char) sequence[i]]);
+		};
+		void clear() { packed_bases.clear(); base_count = 0; };
+		bool empty() const { return base_count == 0; };
+		string::size_type size() const { return base_count; };
+		string::size_type length() const { return base_count; };
+		uint8_t base(const string::size_type position) const { return (((uint8_t) packed_bases[position/2]) >> ((~position & 1) << 2)) & 0x0F; }; // base in 4-bit encoding
+		char operator[](const string::size_type position) const { return seq_nt16_str[base(position)]; };
+		string substr(const string::size_type position, string::size_type length = string::npos) const {
+			if (position > base_count)
+				throw out_of_range("packed_sequence_t::substr");
+			length = min(length, base_count - position);
+			string result(length, 'N');
+			if (length > 0)
+				decode_nt16_sequence((const uint8_t*) packed_bases.data(), position, length, &result[0]);
+			return result;
+		};
+		string str() const { return substr(0); };
+		packed_sequence_t reverse_complement() const {
+			packed_sequence_t result;
+			result.base_count = base_count;
+			result.packed_bases.assign(packed_bases.size(), 0);
+			for (unsigned int i = 0; i < base_count; ++i)
+				result.set_base(base_count - i - 1, complement_base(base(i)));
+			return result;
+		};
+};
+
 struct alignment_t {
 	bool supplementary;
 	bool first_in_pair;
@@ -198,8 +574,8 @@ struct alignment_t {
 	position_t start;
 	position_t end;
 	cigar_t cigar;
-	string sequence;
-	gene_set_t genes;
+	packed_sequence_t sequence;
+	interned_gene_set_t genes;
 	alignment_t(): supplementary(false), first_in_pair(false), exonic(false), predicted_strand_ambiguous(true) {};
 	unsigned int preclipping() const { return (cigar.operation(0) == BAM_CSOFT_CLIP || cigar.operation(0) == BAM_CHARD_CLIP) ? cigar.op_length(0) : 0; };
 	unsigned int postclipping() const { return (cigar.operation(cigar.size()-1) == BAM_CSOFT_CLIP || cigar.operation(cigar.size()-1) == BAM_CHARD_CLIP) ? cigar.op_length(cigar.size()-1) : 0; };
@@ -216,7 +592,89 @@ class mates_t: public vector<alignment_t> {
 		filter_t filter; // ID of the filter which discarded the reads
 		mates_t(): single_end(false), multimapper(false), duplicate(false), filter(FILTER_none) {};
 };
-typedef map<string,mates_t> chimeric_alignments_t; // this must be an ordered map, because finding multi-mapping reads requires reads to be grouped by name
+// chimeric alignments are kept in a flat vector rather than a tree to improve locality and to reduce the number of allocations
+// the read names are interned in an arena and indexed by an open-addressing hash table, so storing a read does not allocate a node or a string
+// once loading is complete, the alignments are sorted by name, because finding multi-mapping reads requires reads to be grouped by name
+// => from then on, alignments must neither be added nor removed, such that the iterators held by fusions remain valid
+const size_t CHIMERIC_ALIGNMENTS_MIN_INDEX_SIZE = 1024; // must be a power of 2
+class chimeric_alignments_t: private vector< pair<const char*,mates_t> > {
+	private:
+		enum { EMPTY_SLOT = (size_type) -1 };
+		string_arena_t read_names;
+		vector<size_type> index_by_name; // maps the hash of a read name to the position of the alignments (linear probing, power-of-2 size)
+		static bool compare_by_name(const value_type& x, const value_type& y) { return strcmp(x.first, y.first) < 0; };
+		static size_t hash_read_name(const char* read_name, const size_t length) { // FNV-1a
+			size_t hash = 14695981039346656037ULL;
+			for (size_t i = 0; i < length; ++i)
+				hash = (hash ^ (unsigned char) read_name[i]) * 1099511628211ULL;
+			return hash;
+		};
+		// returns the slot holding the given name or the empty slot where the name would be inserted
+		size_type find_slot(const char* read_name, const size_t length) const {
+			const size_type mask = index_by_name.size() - 1;
+			for (size_type slot = hash_read_name(read_name, length) & mask; ; slot = (slot + 1) & mask) {
+				const size_type position = index_by_name[slot];
+				if (position == EMPTY_SLOT || strncmp((*this)[position].first, read_name, length) == 0 && (*this)[position].first[length] == '\0')
+					return slot;
+			}
+		};
+		void rebuild_index(const size_type index_size) {
+			index_by_name.assign(index_size, EMPTY_SLOT);
+			for (size_type position = 0; position < size(); ++position)
+				index_by_name[find_slot((*this)[position].first, strlen((*this)[position].first))] = position;
+		};
+	public:
+		// only read-only members of the vector are exposed, because modifications would have to update the index
+		using vector<value_type>::value_type;
+		using vector<value_type>::size_type;
+		using vector<value_type>::iterator;
+		using vector<value_type>::const_iterator;
+		using vector<value_type>::begin;
+		using vector<value_type>::end;
+		using vector<value_type>::size;
+		using vector<value_type>::empty;
+		using vector<value_type>::operator[];
+		iterator find(const char* read_name, const size_t length) {
+			if (index_by_name.empty())
+				return end();
+			size_type position = index_by_name[find_slot(read_name, length)];
+			return (position == EMPTY_SLOT) ? end() : begin() + position;
+		};
+		iterator find(const string& read_name) { return find(read_name.c_str(), read_name.size()); };
+		// the name is copied into the arena, if the read is not stored yet
+		pair<iterator,bool> insert(const char* read_name, const size_t length, const mates_t& mates) {
+			if (2 * (size() + 1) > index_by_name.size()) // keep the load factor below 0.5
+				rebuild_index(max(CHIMERIC_ALIGNMENTS_MIN_INDEX_SIZE, 2 * index_by_name.size()));
+			size_type& slot = index_by_name[find_slot(read_name, length)];
+			if (slot != EMPTY_SLOT)
+				return make_pair(begin() + slot, false);
+			slot = size();
+			push_back(value_type(read_names.add(read_name, length), mates));
+			return make_pair(end() - 1, true);
+		};
+		pair<iterator,bool> insert(const string& read_name, const mates_t& mates) { return insert(read_name.c_str(), read_name.size(), mates); };
+		pair<iterator,bool> insert(const value_type& mates) { return insert(mates.first, strlen(mates.first), mates.second); };
+		mates_t& operator[](const string& read_name) {
+			iterator existing_mates = find(read_name);
+			if (existing_mates != end())
+				return existing_mates->second;
+			return insert(read_name, mates_t()).first->second;
+		};
+		void erase_empty_mates() { // removes all reads without alignments in a single pass
+			erase(remove_if(begin(), end(), has_no_alignments), end());
+			rebuild_index(index_by_name.size());
+		};
+		static bool has_no_alignments(const value_type& mates) { return mates.second.empty(); };
+		void sort_by_name() {
+			sort(begin(), end(), compare_by_name);
+			rebuild_index(index_by_name.size());
+		};
+		void clear() {
+			vector<value_type>::clear();
+			read_names.clear();
+			index_by_name.clear();
+		};
+};
 // convenience function to undo appending of the HI tag separated by a comma to distinguish multi-mapping reads
 inline string strip_hi_tag_from_read_name(const string& read_name) { return read_name.substr(0, read_name.find_last_of(',')); };
 
@@ -37,13 +37,13 @@ unsigned int filter_hairpin(chimeric_alignments_t& chimeric_alignments, exon_ann
 		// check if mate1 and mate2 map to the same gene or close to one another
 		gene_set_t common_genes;
 		if (chimeric_alignment->second.size() == 2) { // discordant mate
-			combine_annotations(chimeric_alignment->second[MATE1].genes, chimeric_alignment->second[MATE2].genes, common_genes, false);
+			combine_annotations(chimeric_alignment->second[MATE1].genes.get(), chimeric_alignment->second[MATE2].genes.get(), common_genes, false);
 			if (common_genes.empty() && chimeric_alignment->second[MATE1].contig != chimeric_alignment->second[MATE2].contig) {
 				remaining++;
 				continue; // we are only interested in intragenic events
 			}
 		} else {// split read
-			combine_annotations(chimeric_alignment->second[SPLIT_READ].genes, chimeric_alignment->second[SUPPLEMENTARY].genes, common_genes, false);
+			combine_annotations(chimeric_alignment->second[SPLIT_READ].genes.get(), chimeric_alignment->second[SUPPLEMENTARY].genes.get(), common_genes, false);
 			if (common_genes.empty() && chimeric_alignment->second[SPLIT_READ].contig != chimeric_alignment->second[SUPPLEMENTARY].contig) {
 				remaining++;
 				continue; // we are only interested in intragenic events
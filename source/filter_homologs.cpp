@@ -1,5 +1,4 @@
 #include <cmath>
-#include <cstring>
 #include <list>
 #include <string>
 #include "common.hpp"
@@ -47,7 +46,7 @@ bool is_homolog(const gene_t gene1, const gene_t gene2, const kmer_indices_t& km
 		if (kmer_hits != kmer_indices[big_gene->contig].end()) {
 			for (auto kmer_hit = lower_bound(kmer_hits->second.begin(), kmer_hits->second.end(), big_gene->start); kmer_hit != kmer_hits->second.end() && *kmer_hit <= big_gene->end; ++kmer_hit) {
 				if (small_gene->contig != big_gene->contig || *kmer_hit < small_gene->start || *kmer_hit > small_gene->end) {
-					if (strncmp(assembly.at(big_gene->contig).c_str()+*kmer_hit+kmer_length, small_gene_sequence.c_str()+pos+kmer_length, extended_kmer_length) == 0) {
+					if (assembly.at(big_gene->contig).matches(*kmer_hit+kmer_length, small_gene_sequence.c_str()+pos+kmer_length, extended_kmer_length)) {
 						matching_kmers++;
 						if (matching_kmers * kmer_length >= small_gene->length() * max_identity_fraction)
 							return true;
@@ -4,16 +4,16 @@
 
 using namespace std;
 
-bool is_split_read_spliced(const alignment_t& split_read, const exon_annotation_index_t& exon_annotation_index) {
+bool is_split_read_spliced(const alignment_t& split_read) {
 	direction_t direction = (split_read.strand == FORWARD) ? UPSTREAM : DOWNSTREAM;
 	position_t breakpoint = (split_read.strand == FORWARD) ? split_read.start : split_read.end;
 	for (gene_set_t::const_iterator gene = split_read.genes.begin(); gene != split_read.genes.end(); ++gene)
-		if (is_breakpoint_spliced(*gene, direction, breakpoint, exon_annotation_index))
+		if (is_breakpoint_spliced(*gene, direction, breakpoint))
 			return true;
 	return false;
 }
 
-unsigned int filter_homopolymer(chimeric_alignments_t& chimeric_alignments, const unsigned int homopolymer_length, const exon_annotation_index_t& exon_annotation_index) {
+unsigned int filter_homopolymer(chimeric_alignments_t& chimeric_alignments, const unsigned int homopolymer_length) {
 	unsigned int remaining = 0;
 	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
 		if (chimeric_alignment->second.filter != FILTER_none)
@@ -41,7 +41,7 @@ unsigned int filter_homopolymer(chimeric_alignments_t& chimeric_alignments, cons
 				if (sequence[c-1] == sequence[c]) {
 					run++;
 					if (run == homopolymer_length) {
-						if (!is_split_read_spliced(chimeric_alignment->second[SPLIT_READ], exon_annotation_index)) {
+						if (!is_split_read_spliced(chimeric_alignment->second[SPLIT_READ])) {
 							chimeric_alignment->second.filter = FILTER_homopolymer;
 							goto next_read;
 						}
@@ -5,6 +5,6 @@
 
 using namespace std;
 
-unsigned int filter_homopolymer(chimeric_alignments_t& chimeric_alignments, const unsigned int homopolymer_length, const exon_annotation_index_t& exon_annotation_index);
+unsigned int filter_homopolymer(chimeric_alignments_t& chimeric_alignments, const unsigned int homopolymer_length);
 
 #endif /* FILTER_HOMOPOLYMER_H */
@@ -19,9 +19,8 @@ template <class K, class V> V find_or_default(const unordered_map<K,V>& m, const
 // check if there is a gene which overlaps the given breakpoint and is expressed at a higher level than <highest_expressed_gene>
 gene_t find_higher_expressed_gene(const contig_t contig, const position_t breakpoint, const gene_annotation_index_t& gene_annotation_index, const unordered_map<gene_t,unsigned int>& expression_by_gene, gene_t highest_expressed_gene) {
 	unsigned int highest_expression = find_or_default(expression_by_gene, highest_expressed_gene, (unsigned int) 0);
-	gene_set_t genes_overlapping_breakpoint;
-	get_annotation_by_coordinate(contig, breakpoint, breakpoint, genes_overlapping_breakpoint, gene_annotation_index);
-	for (gene_set_t::iterator gene = genes_overlapping_breakpoint.begin(); gene != genes_overlapping_breakpoint.end(); ++gene) {
+	gene_span_t genes_overlapping_breakpoint = get_annotation_at_position(contig, breakpoint, gene_annotation_index);
+	for (gene_span_t::const_iterator gene = genes_overlapping_breakpoint.begin(); gene != genes_overlapping_breakpoint.end(); ++gene) {
 		unsigned int expression = find_or_default(expression_by_gene, *gene, (unsigned int) 0);
 		if (expression > highest_expression) {
 			highest_expression = expression;
@@ -13,17 +13,20 @@ unsigned int filter_low_coverage_viral_contigs(chimeric_alignments_t& chimeric_a
 	// compute average coverage for each viral contig
 	vector<float> average_coverage(viral_contigs.size());
 	for (contig_t contig = 0; contig < viral_contigs.size(); ++contig) {
-		for (auto window = coverage.coverage[contig].begin(); window != coverage.coverage[contig].end(); ++window)
-			average_coverage[contig] += *window;
+		if (!viral_contigs[contig])
+			continue; // the coverage of other contigs is irrelevant
+		for (size_t window = 0; window < coverage.coverage[contig].size(); ++window)
+			average_coverage[contig] += coverage.coverage[contig][window];
 		average_coverage[contig] /= coverage.coverage[contig].size();
 	}
 
 	// for each viral contig, determine fraction that is covered at least as highly as 0.05 * average coverage
 	vector<float> windows_with_sufficient_coverage(viral_contigs.size());
 	for (contig_t contig = 0; contig < viral_contigs.size(); ++contig)
-		for (auto window = coverage.coverage[contig].begin(); window != coverage.coverage[contig].end(); ++window)
-			if (*window > 0.05 * average_coverage[contig])
-				windows_with_sufficient_coverage[contig]++;
+		if (viral_contigs[contig])
+			for (size_t window = 0; window < coverage.coverage[contig].size(); ++window)
+				if (coverage.coverage[contig][window] > 0.05 * average_coverage[contig])
+					windows_with_sufficient_coverage[contig]++;
 
 	unsigned int remaining = 0;
 	for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
@@ -1,5 +1,5 @@
+#include <algorithm>
 #include <cmath>
-#include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -10,25 +10,7 @@
 
 using namespace std;
 
-typedef set<position_t> splice_sites_t;
-typedef unordered_map<gene_t,splice_sites_t> splice_sites_by_gene_t;
-
-void get_downstream_splice_sites(const gene_t gene, const exon_annotation_index_t& exon_annotation_index, splice_sites_t& splice_sites) {
-
-	// nothing to do, if there are no exons on the given contig
-	if (exon_annotation_index[gene->contig].empty()) {
-		splice_sites.clear();
-		return;
-	}
-
-	// find all downstream-oriented splice-sites of the given gene (because alignment is oriented downstream)
-	exon_contig_annotation_index_t::const_iterator exons = exon_annotation_index[gene->contig].lower_bound(gene->start);
-	while (exons != exon_annotation_index[gene->contig].end() && exons->first <= gene->end) {
-		if (is_breakpoint_spliced(gene, DOWNSTREAM, exons->first, exon_annotation_index))
-			splice_sites.insert(exons->first);
-		++exons;
-	}
-}
+typedef vector<position_t> splice_sites_t; // sorted positions of downstream-oriented splice sites (because alignment is oriented downstream)
 
 kmer_as_int_t kmer_to_int(const string& kmer, const string::size_type position, const char kmer_length) {
 	kmer_as_int_t result = 0;
@@ -44,6 +26,21 @@ kmer_as_int_t kmer_to_int(const string& kmer, const string::size_type position,
 	return result;
 }
 
+// same as above, but without decoding the sequence
+kmer_as_int_t kmer_to_int(const packed_sequence_t& kmer, const string::size_type position, const char kmer_length) {
+	kmer_as_int_t result = 0;
+	for (char base = 0; base < kmer_length; ++base) {
+		result = result<<2;
+		switch (kmer.base(position + base)) {
+			case 8/*T*/: result += 0; break;
+			case 4/*G*/: result += 1; break;
+			case 2/*C*/: result += 2; break;
+			default:     result += 3; break;
+		}
+	}
+	return result;
+}
+
 void make_kmer_index(const fusions_t& fusions, const assembly_t& assembly, int padding, const char kmer_length, kmer_indices_t& kmer_indices) {
 
 	// find genes which are involved in fusions which have not been discarded yet
@@ -63,14 +60,17 @@ void make_kmer_index(const fusions_t& fusions, const assembly_t& assembly, int p
 
 	// store positions of kmers in hash
 	for (gene_set_t::iterator gene = genes_to_filter.begin(); gene != genes_to_filter.end(); ++gene) {
-		const string& contig_sequence = assembly.at((**gene).contig);
+		const contig_sequence_t& contig_sequence = assembly.at((**gene).contig);
 		if ((int) kmer_indices.size() <= (**gene).contig)
 			kmer_indices.resize((**gene).contig+1);
 		position_t gene_start = max((**gene).start - padding, 0);
 		position_t gene_end = min((**gene).end + padding, (int) assembly.at((**gene).contig).size() - 1);
+		if (gene_start >= gene_end)
+			continue;
+		const string gene_sequence = contig_sequence.substr(gene_start, gene_end - gene_start); // decode the sequence once rather than every base of every kmer
 		for (position_t pos = gene_start; pos + kmer_length < gene_end; pos++)
-			if (contig_sequence[pos] != 'N') // don't index masked regions, as long stretches of N's inflate the number of hits
-				kmer_indices[(**gene).contig][kmer_to_int(contig_sequence, pos, kmer_length)].push_back(pos);
+			if (gene_sequence[pos - gene_start] != 'N') // don't index masked regions, as long stretches of N's inflate the number of hits
+				kmer_indices[(**gene).contig][kmer_to_int(gene_sequence, pos - gene_start, kmer_length)].push_back(pos);
 	}
 
 	// sort kmer hits by increasing position, so that we can go through the list sequentially
@@ -83,7 +83,7 @@ void make_kmer_index(const fusions_t& fusions, const assembly_t& assembly, int p
 		}
 }
 
-bool align(int score, const string& read_sequence, int read_pos, const string& contig_sequence, const int gene_pos, const position_t gene_start, const position_t gene_end, const kmer_index_t& kmer_index, const char kmer_length, const splice_sites_t& splice_sites, const int min_score, int max_deletions) {
+bool align(int score, const string& read_sequence, int read_pos, const contig_sequence_t& contig_sequence, const int gene_pos, const position_t gene_start, const position_t gene_end, const kmer_index_t& kmer_index, const char kmer_length, const splice_sites_t& splice_sites, const int min_score, int max_deletions) {
 
 	int skipped_bases = 0;
 
@@ -142,7 +142,7 @@ bool align(int score, const string& read_sequence, int read_pos, const string& c
 				int extended_gene_pos = *kmer_hit + kmer_length;
 				unsigned int mismatch_count = 0;
 				unsigned int consecutive_mismatches = 0;
-				splice_sites_t::const_iterator next_splice_site = splice_sites.lower_bound(extended_gene_pos - 1);
+				splice_sites_t::const_iterator next_splice_site = lower_bound(splice_sites.begin(), splice_sites.end(), extended_gene_pos - 1);
 				while (extended_read_pos < (int) read_sequence.length() && extended_gene_pos <= gene_end) {
 
 					// try a spliced alignment, if we run over a splice-site
@@ -186,14 +186,10 @@ bool align(int score, const string& read_sequence, int read_pos, const string& c
 	return false;
 }
 
-bool align_both_strands(const string& read_sequence, const int read_length, const int max_mate_gap, const bool breakpoints_on_same_contig, const position_t alignment_start, const position_t alignment_end, const kmer_indices_t& kmer_indices, const assembly_t& assembly, const exon_annotation_index_t& exon_annotation_index, splice_sites_by_gene_t& splice_sites_by_gene, gene_set_t& genes, const char kmer_length, const float min_align_fraction) {
+bool align_both_strands(const string& read_sequence, const int read_length, const int max_mate_gap, const bool breakpoints_on_same_contig, const position_t alignment_start, const position_t alignment_end, const kmer_indices_t& kmer_indices, const assembly_t& assembly, const gene_set_t& genes, const char kmer_length, const float min_align_fraction) {
 
 	int min_score = min_align_fraction * read_sequence.size() + 0.5;
-	for (gene_set_t::iterator gene = genes.begin(); gene != genes.end(); ++gene) {
-
-		// find all splice sites in the genes
-		if (splice_sites_by_gene.find(*gene) == splice_sites_by_gene.end())
-			get_downstream_splice_sites(*gene, exon_annotation_index, splice_sites_by_gene[*gene]);
+	for (gene_set_t::const_iterator gene = genes.begin(); gene != genes.end(); ++gene) {
 
 		// align against gene and some padding around the gene (but not beyond contig boundaries)
 		position_t gene_start = max((**gene).start - max_mate_gap - read_length, 0);
@@ -207,13 +203,13 @@ bool align_both_strands(const string& read_sequence, const int read_length, cons
 		     alignment_end   >= gene_start && alignment_end   <= gene_end))
 			continue;
 
-		if (align(0, read_sequence, 0, assembly.at((**gene).contig), gene_start, gene_start, gene_end, kmer_indices[(**gene).contig], kmer_length, splice_sites_by_gene.at(*gene), min_score, 1)) { // align on forward strand
+		if (align(0, read_sequence, 0, assembly.at((**gene).contig), gene_start, gene_start, gene_end, kmer_indices[(**gene).contig], kmer_length, (**gene).downstream_splice_sites, min_score, 1)) { // align on forward strand
 			return true;
 		} else { // align on reverse strand
 			string reverse_complement;
 			string original = read_sequence;
 			dna_to_reverse_complement(original, reverse_complement);
-			if (align(0, reverse_complement, 0, assembly.at((**gene).contig), gene_start, gene_start, gene_end, kmer_indices[(**gene).contig], kmer_length, splice_sites_by_gene.at(*gene), min_score, 1))
+			if (align(0, reverse_complement, 0, assembly.at((**gene).contig), gene_start, gene_start, gene_end, kmer_indices[(**gene).contig], kmer_length, (**gene).downstream_splice_sites, min_score, 1))
 				return true;
 		}
 	}
@@ -260,13 +256,11 @@ bool extend_split_read(const alignment_t& split_read, const assembly_t& assembly
 	return matching_bases >= floor(clipped_sequence.size() * min_align_fraction);
 }
 
-unsigned int filter_mismappers(fusions_t& fusions, const kmer_indices_t& kmer_indices, const char kmer_length, const assembly_t& assembly, const exon_annotation_index_t& exon_annotation_index, const float max_mismapper_fraction, const int max_mate_gap) {
+unsigned int filter_mismappers(fusions_t& fusions, const kmer_indices_t& kmer_indices, const char kmer_length, const assembly_t& assembly, const float max_mismapper_fraction, const int max_mate_gap) {
 
 	const float min_align_fraction = 0.8; // allow ~1 mismatch for every 10 matches
 	const float min_extended_align_fraction = 0.7; // be more lenient when simply extending an alignment
 
-	splice_sites_by_gene_t splice_sites_by_gene;
-
 	// align discordnat mate / clipped segment in gene of origin
 	for (fusions_t::iterator fusion = fusions.begin(); fusion != fusions.end(); ++fusion) {
 
@@ -289,14 +283,14 @@ unsigned int filter_mismappers(fusions_t& fusions, const kmer_indices_t& kmer_in
 
 			if (split_read.strand == FORWARD) {
 				if (extend_split_read(split_read, assembly, min_extended_align_fraction) ||
-				    align_both_strands(split_read.sequence.substr(0, split_read.preclipping()), split_read.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, supplementary.start, supplementary.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, split_read.genes, kmer_length, min_align_fraction) || // clipped segment aligns to donor
-				    align_both_strands(mate1.sequence.substr(mate1.preclipping()), mate1.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate1.start, mate1.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, supplementary.genes, kmer_length, min_align_fraction)) { // non-spliced mate aligns to acceptor
+				    align_both_strands(split_read.sequence.substr(0, split_read.preclipping()), split_read.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, supplementary.start, supplementary.end, kmer_indices, assembly, split_read.genes, kmer_length, min_align_fraction) || // clipped segment aligns to donor
+				    align_both_strands(mate1.sequence.substr(mate1.preclipping()), mate1.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate1.start, mate1.end, kmer_indices, assembly, supplementary.genes, kmer_length, min_align_fraction)) { // non-spliced mate aligns to acceptor
 					(**chimeric_alignment).second.filter = FILTER_mismappers;
 				}
 			} else { // split_read.strand == REVERSE
 				if (extend_split_read(split_read, assembly, min_extended_align_fraction) ||
-				    align_both_strands(split_read.sequence.substr(split_read.sequence.length() - split_read.postclipping()), split_read.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, supplementary.start, supplementary.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, split_read.genes, kmer_length, min_align_fraction) || // clipped segment aligns to donor
-				    align_both_strands(mate1.sequence.substr(0, mate1.sequence.length() - mate1.postclipping()), mate1.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate1.start, mate1.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, supplementary.genes, kmer_length, min_align_fraction)) { // non-spliced mate aligns to acceptor
+				    align_both_strands(split_read.sequence.substr(split_read.sequence.length() - split_read.postclipping()), split_read.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, supplementary.start, supplementary.end, kmer_indices, assembly, split_read.genes, kmer_length, min_align_fraction) || // clipped segment aligns to donor
+				    align_both_strands(mate1.sequence.substr(0, mate1.sequence.length() - mate1.postclipping()), mate1.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate1.start, mate1.end, kmer_indices, assembly, supplementary.genes, kmer_length, min_align_fraction)) { // non-spliced mate aligns to acceptor
 					(**chimeric_alignment).second.filter = FILTER_mismappers;
 				}
 			}
@@ -317,8 +311,8 @@ unsigned int filter_mismappers(fusions_t& fusions, const kmer_indices_t& kmer_in
 			float clipped_fraction1 = ((float) mate1.preclipping() + mate1.postclipping()) / mate1.sequence.size();
 			float clipped_fraction2 = ((float) mate2.preclipping() + mate2.postclipping()) / mate2.sequence.size();
 
-			if (align_both_strands(mate1.sequence, mate1.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate1.start, mate1.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, mate2.genes, kmer_length, min(min_align_fraction, min_align_fraction*(1-clipped_fraction1))) ||
-			    align_both_strands(mate2.sequence, mate2.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate2.start, mate2.end, kmer_indices, assembly, exon_annotation_index, splice_sites_by_gene, mate1.genes, kmer_length, min(min_align_fraction, min_align_fraction*(1-clipped_fraction2)))) {
+			if (align_both_strands(mate1.sequence.str(), mate1.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate1.start, mate1.end, kmer_indices, assembly, mate2.genes, kmer_length, min(min_align_fraction, min_align_fraction*(1-clipped_fraction1))) ||
+			    align_both_strands(mate2.sequence.str(), mate2.sequence.size(), max_mate_gap, fusion->second.contig1 == fusion->second.contig2, mate2.start, mate2.end, kmer_indices, assembly, mate1.genes, kmer_length, min(min_align_fraction, min_align_fraction*(1-clipped_fraction2)))) {
 				(**chimeric_alignment).second.filter = FILTER_mismappers;
 			}
 		}
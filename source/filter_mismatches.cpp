@@ -9,7 +9,7 @@
 
 using namespace std;
 
-void count_mismatches(const alignment_t& alignment, const string& sequence, const assembly_t& assembly, unsigned int& mismatches, unsigned int& alignment_length) {
+void count_mismatches(const alignment_t& alignment, const packed_sequence_t& sequence, const assembly_t& assembly, unsigned int& mismatches, unsigned int& alignment_length) {
 
 	// calculate template length and the number of mismatches
 	mismatches = 0;
@@ -39,7 +39,7 @@ void count_mismatches(const alignment_t& alignment, const string& sequence, cons
 			case BAM_CEQUAL:
 			case BAM_CDIFF:
 				for (unsigned int operation_i = 1; operation_i <= alignment.cigar.op_length(i); ++operation_i) {
-					if (sequence[read_position] != 'N') {
+					if (sequence.base(read_position) != 15/*N*/) {
 						if (sequence[read_position] != assembly.at(alignment.contig)[reference_position])
 							mismatches++;
 						alignment_length++;
@@ -68,7 +68,7 @@ float calculate_binomial_distribution(const unsigned int k, const unsigned int n
 	return calculate_binomial_coefficient(k, n) * pow(p, k) * pow(1-p, n-k);
 }
 
-bool test_mismatch_probability(const alignment_t& alignment, const string& sequence, const assembly_t& assembly, const float mismatch_probability, long unsigned int genome_size, const float pvalue_cutoff, const bool is_multimapper) {
+bool test_mismatch_probability(const alignment_t& alignment, const packed_sequence_t& sequence, const assembly_t& assembly, const float mismatch_probability, long unsigned int genome_size, const float pvalue_cutoff, const bool is_multimapper) {
 
 	// Alignment artifacts with many mismatches arise from two sources:
 	// 1. read incorrectly aligned to homologous sequence
@@ -123,7 +123,7 @@ unsigned int filter_mismatches(chimeric_alignments_t& chimeric_alignments, const
 			}
 		} else { // split read
 			if (!viral_contigs[chimeric_alignment->second[MATE1].contig] && test_mismatch_probability(chimeric_alignment->second[MATE1], chimeric_alignment->second[MATE1].sequence, assembly, mismatch_probability, genome_size, pvalue_cutoff, chimeric_alignment->second.multimapper && !viral_contigs[chimeric_alignment->second[SUPPLEMENTARY].contig]) ||
-			    !viral_contigs[chimeric_alignment->second[SUPPLEMENTARY].contig] && test_mismatch_probability(chimeric_alignment->second[SUPPLEMENTARY], (chimeric_alignment->second[SUPPLEMENTARY].strand == chimeric_alignment->second[SPLIT_READ].strand) ? chimeric_alignment->second[SPLIT_READ].sequence : dna_to_reverse_complement(chimeric_alignment->second[SPLIT_READ].sequence), assembly, mismatch_probability, genome_size, pvalue_cutoff, chimeric_alignment->second.multimapper && !viral_contigs[chimeric_alignment->second[MATE1].contig])) {
+			    !viral_contigs[chimeric_alignment->second[SUPPLEMENTARY].contig] && test_mismatch_probability(chimeric_alignment->second[SUPPLEMENTARY], (chimeric_alignment->second[SUPPLEMENTARY].strand == chimeric_alignment->second[SPLIT_READ].strand) ? chimeric_alignment->second[SPLIT_READ].sequence : chimeric_alignment->second[SPLIT_READ].sequence.reverse_complement(), assembly, mismatch_probability, genome_size, pvalue_cutoff, chimeric_alignment->second.multimapper && !viral_contigs[chimeric_alignment->second[MATE1].contig])) {
 				chimeric_alignment->second.filter = FILTER_mismatches;
 				continue;
 			}
@@ -7,14 +7,14 @@
 
 using namespace std;
 
-bool is_gap_at_splice_site(const position_t position, const direction_t direction, const gene_set_t& genes, const exon_annotation_index_t& exon_annotation_index) {
+bool is_gap_at_splice_site(const position_t position, const direction_t direction, const gene_set_t& genes) {
 	for (gene_set_t::const_iterator gene = genes.begin(); gene != genes.end(); ++gene)
-		if (is_breakpoint_spliced(*gene, direction, position, exon_annotation_index))
+		if (is_breakpoint_spliced(*gene, direction, position))
 			return true;
 	return false;
 }
 
-int calculate_segment_score(const alignment_t& alignment, const string& sequence, const exon_annotation_index_t& exon_annotation_index, const assembly_t& assembly) {
+int calculate_segment_score(const alignment_t& alignment, const packed_sequence_t& sequence, const assembly_t& assembly) {
 
 	if (assembly.find(alignment.contig) == assembly.end())
 		return 0;
@@ -33,8 +33,8 @@ int calculate_segment_score(const alignment_t& alignment, const string& sequence
 				reference_position += alignment.cigar.op_length(i);
 				break;
 			case BAM_CREF_SKIP:
-				if (!is_gap_at_splice_site(reference_position, DOWNSTREAM, alignment.genes, exon_annotation_index) ||
-				    !is_gap_at_splice_site(reference_position + alignment.cigar.op_length(i), UPSTREAM, alignment.genes, exon_annotation_index))
+				if (!is_gap_at_splice_site(reference_position, DOWNSTREAM, alignment.genes) ||
+				    !is_gap_at_splice_site(reference_position + alignment.cigar.op_length(i), UPSTREAM, alignment.genes))
 					score--; // penalize reference skips except at splice sites
 				reference_position += alignment.cigar.op_length(i);
 				break;
@@ -62,16 +62,16 @@ int calculate_segment_score(const alignment_t& alignment, const string& sequence
 	return score;
 }
 
-int calculate_alignment_score(const mates_t& mates, const exon_annotation_index_t& exon_annotation_index, const assembly_t& assembly) {
+int calculate_alignment_score(const mates_t& mates, const assembly_t& assembly) {
 
-	int score = calculate_segment_score(mates[MATE1], mates[MATE1].sequence, exon_annotation_index, assembly) +
-	            calculate_segment_score(mates[MATE2], mates[MATE2].sequence, exon_annotation_index, assembly);
+	int score = calculate_segment_score(mates[MATE1], mates[MATE1].sequence, assembly) +
+	            calculate_segment_score(mates[MATE2], mates[MATE2].sequence, assembly);
 
 	if (mates.size() == 3) { // has a supplementary alignment
-		score += calculate_segment_score(mates[SUPPLEMENTARY], (mates[SUPPLEMENTARY].strand == mates[SPLIT_READ].strand) ? mates[SPLIT_READ].sequence : dna_to_reverse_complement(mates[SPLIT_READ].sequence), exon_annotation_index, assembly);
+		score += calculate_segment_score(mates[SUPPLEMENTARY], (mates[SUPPLEMENTARY].strand == mates[SPLIT_READ].strand) ? mates[SPLIT_READ].sequence : mates[SPLIT_READ].sequence.reverse_complement(), assembly);
 		// penalize if the read is not split at a splice site
-		if (!is_gap_at_splice_site((mates[SUPPLEMENTARY].strand == FORWARD) ? mates[SUPPLEMENTARY].end : mates[SUPPLEMENTARY].start, (mates[SUPPLEMENTARY].strand == FORWARD) ? DOWNSTREAM : UPSTREAM, mates[SUPPLEMENTARY].genes, exon_annotation_index) ||
-		    !is_gap_at_splice_site((mates[SPLIT_READ].strand == FORWARD) ? mates[SPLIT_READ].start : mates[SPLIT_READ].end, (mates[SPLIT_READ].strand == FORWARD) ? UPSTREAM : DOWNSTREAM, mates[SPLIT_READ].genes, exon_annotation_index))
+		if (!is_gap_at_splice_site((mates[SUPPLEMENTARY].strand == FORWARD) ? mates[SUPPLEMENTARY].end : mates[SUPPLEMENTARY].start, (mates[SUPPLEMENTARY].strand == FORWARD) ? DOWNSTREAM : UPSTREAM, mates[SUPPLEMENTARY].genes) ||
+		    !is_gap_at_splice_site((mates[SPLIT_READ].strand == FORWARD) ? mates[SPLIT_READ].start : mates[SPLIT_READ].end, (mates[SPLIT_READ].strand == FORWARD) ? UPSTREAM : DOWNSTREAM, mates[SPLIT_READ].genes))
 			score--;
 	}
 
@@ -112,7 +112,7 @@ bool fusion_has_more_support(const fusion_t* fusion, const fusion_t* current_bes
 // this function performs two tasks on multi-mapping reads:
 // - when a read is assigned to multiple fusion candidates, is picks the candidate with the most supporting reads 
 // - it selects the alignment with the highest alignment score
-unsigned int filter_multimappers(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, const exon_annotation_index_t& exon_annotation_index, const assembly_t& assembly) {
+unsigned int filter_multimappers(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, const assembly_t& assembly) {
 
 	// for each multi-mapper, find the fusion with the most supporting reads
 	unordered_map<mates_t*,fusion_t*> most_supported_fusion;
@@ -175,7 +175,7 @@ unsigned int filter_multimappers(chimeric_alignments_t& chimeric_alignments, fus
 			continue;
 
 		// calculate alignment score and remember the best one
-		int alignment_score = calculate_alignment_score(chimeric_alignment->second, exon_annotation_index, assembly);
+		int alignment_score = calculate_alignment_score(chimeric_alignment->second, assembly);
 		if (best_alignment_score < alignment_score) {
 			best_alignment = &chimeric_alignment->second;
 			best_alignment_score = alignment_score;
@@ -5,6 +5,6 @@
 
 using namespace std;
 
-unsigned int filter_multimappers(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, const exon_annotation_index_t& exon_annotation_index, const assembly_t& assembly);
+unsigned int filter_multimappers(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, const assembly_t& assembly);
 
 #endif /* FILTER_MULTIMAPPERS_H */
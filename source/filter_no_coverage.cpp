@@ -40,8 +40,7 @@ unsigned int filter_no_coverage(fusions_t& fusions, const coverage_t& coverage,
 		bool is_in_terminal_exon;
 
 		// check if breakpoint1 is in a terminal exon
-		exon_set_t exons;
-		get_annotation_by_coordinate(fusion->second.contig1, fusion->second.breakpoint1, fusion->second.breakpoint1, exons, exon_annotation_index);
+		exon_span_t exons = get_annotation_at_position(fusion->second.contig1, fusion->second.breakpoint1, exon_annotation_index);
 		is_in_terminal_exon = false;
 		for (auto exon = exons.begin(); exon != exons.end() && !is_in_terminal_exon; ++exon)
 			if ((**exon).gene == fusion->second.gene1 && ((**exon).previous_exon == NULL || (**exon).next_exon == NULL))
@@ -68,8 +67,7 @@ unsigned int filter_no_coverage(fusions_t& fusions, const coverage_t& coverage,
 		}
 
 		// check if breakpoint2 is in a terminal exon
-		exons.clear();
-		get_annotation_by_coordinate(fusion->second.contig2, fusion->second.breakpoint2, fusion->second.breakpoint2, exons, exon_annotation_index);
+		exons = get_annotation_at_position(fusion->second.contig2, fusion->second.breakpoint2, exon_annotation_index);
 		is_in_terminal_exon = false;
 		for (auto exon = exons.begin(); exon != exons.end() && !is_in_terminal_exon; ++exon)
 			if ((**exon).gene == fusion->second.gene2 && ((**exon).previous_exon == NULL || (**exon).next_exon == NULL))
@@ -14,9 +14,9 @@ unsigned int filter_same_gene(chimeric_alignments_t& chimeric_alignments, exon_a
 		// check if mate1 and mate2 map to the same gene
 		gene_set_t common_genes;
 		if (chimeric_alignment->second.size() == 2) // discordant mate
-			combine_annotations(chimeric_alignment->second[MATE1].genes, chimeric_alignment->second[MATE2].genes, common_genes, false);
+			combine_annotations(chimeric_alignment->second[MATE1].genes.get(), chimeric_alignment->second[MATE2].genes.get(), common_genes, false);
 		else // split read
-			combine_annotations(chimeric_alignment->second[MATE2].genes, chimeric_alignment->second[SUPPLEMENTARY].genes, common_genes, false);
+			combine_annotations(chimeric_alignment->second[MATE2].genes.get(), chimeric_alignment->second[SUPPLEMENTARY].genes.get(), common_genes, false);
 		if (common_genes.empty()) {
 			remaining++;
 			continue; // we are only interested in intragenic events here
@@ -20,25 +20,26 @@ struct sort_contigs_by_expression_t {
 };
 
 // determine if viruses are related based on fraction of shared kmers in their genome
-bool related_viral_strains(const string& virus1, const string& virus2) {
+bool related_viral_strains(const contig_sequence_t& virus1, const contig_sequence_t& virus2) {
 
 	// choose smaller of the two viruses for making a list of its kmers
-	const string* small_virus = &virus1;
-	const string* big_virus = &virus2;
-	if (small_virus->size() > big_virus->size())
+	// the sequences are decoded once, rather than every base of every kmer
+	string small_virus = virus1.substr(0);
+	string big_virus = virus2.substr(0);
+	if (small_virus.size() > big_virus.size())
 		swap(small_virus, big_virus);
 
 	// get all kmers of smaller virus
 	const char kmer_length = 12;
 	map<kmer_as_int_t, unsigned int/*non-zero if shared*/> small_virus_kmers;
-	for (size_t i = 0; i + kmer_length <= small_virus->size(); i++)
-		small_virus_kmers[kmer_to_int(*small_virus, i, kmer_length)] = 0;
+	for (size_t i = 0; i + kmer_length <= small_virus.size(); i++)
+		small_virus_kmers[kmer_to_int(small_virus, i, kmer_length)] = 0;
 
 	// calculate fraction of kmers of small virus also found in big virus
 	unsigned int shared_kmers = 0;
 	const unsigned int min_shared_kmers = small_virus_kmers.size() / 10; // consider viruses related if at least this fraction of kmers is shared
-	for (size_t i = 0; i + kmer_length <= big_virus->size(); i++) {
-		auto small_virus_kmer_count = small_virus_kmers.find(kmer_to_int(*big_virus, i, kmer_length));
+	for (size_t i = 0; i + kmer_length <= big_virus.size(); i++) {
+		auto small_virus_kmer_count = small_virus_kmers.find(kmer_to_int(big_virus, i, kmer_length));
 		if (small_virus_kmer_count != small_virus_kmers.end() && small_virus_kmer_count->second++ == 0) // don't count repetitive kmers more than once
 			if (++shared_kmers >= min_shared_kmers)
 				return true;
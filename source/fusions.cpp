@@ -200,7 +200,7 @@ void predict_transcript_start(fusion_t& fusion) {
 }
 
 
-unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, exon_annotation_index_t& exon_annotation_index, const int max_mate_gap, const unsigned int subsampling_threshold) {
+unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t& fusions, const int max_mate_gap, const unsigned int subsampling_threshold) {
 
 	unordered_map< tuple<unsigned int/*gene1->id*/,unsigned int/*gene2->id*/,direction_t/*1*/,direction_t/*2*/>, vector< tuple<position_t/*breakpoint1*/,position_t/*breakpoint2*/,chimeric_alignments_t::iterator> > > discordant_mates_by_gene_pair; // contains the discordant mates for each pair of genes
 
@@ -211,7 +211,7 @@ unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t&
 		contig_t contig1, contig2;
 		position_t breakpoint1, breakpoint2;
 		direction_t direction1, direction2;
-		gene_set_t genes1, genes2;
+		interned_gene_set_t genes1, genes2;
 		bool exonic1, exonic2;
 		position_t anchor_start1, anchor_start2;
 
@@ -245,8 +245,8 @@ unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t&
 			}
 
 			// make a fusion from the given breakpoints
-			for (gene_set_t::iterator gene1 = genes1.begin(); gene1 != genes1.end(); ++gene1) {
-				for (gene_set_t::iterator gene2 = genes2.begin(); gene2 != genes2.end(); ++gene2) {
+			for (gene_set_t::const_iterator gene1 = genes1.begin(); gene1 != genes1.end(); ++gene1) {
+				for (gene_set_t::const_iterator gene2 = genes2.begin(); gene2 != genes2.end(); ++gene2) {
 
 					// copy properties of supporting read to fusion
 					pair<fusions_t::iterator,bool> is_new_fusion = fusions.insert(make_pair(make_tuple((**gene1).id, (**gene2).id, contig1, contig2, breakpoint1, breakpoint2, direction1, direction2), fusion_t()));
@@ -327,8 +327,8 @@ unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t&
 			}
 
 			// make a fusion from the given breakpoints
-			for (gene_set_t::iterator gene1 = genes1.begin(); gene1 != genes1.end(); ++gene1) {
-				for (gene_set_t::iterator gene2 = genes2.begin(); gene2 != genes2.end(); ++gene2) {
+			for (gene_set_t::const_iterator gene1 = genes1.begin(); gene1 != genes1.end(); ++gene1) {
+				for (gene_set_t::const_iterator gene2 = genes2.begin(); gene2 != genes2.end(); ++gene2) {
 
 					// copy properties of supporting read to fusion
 					pair<fusions_t::iterator,bool> is_new_fusion = fusions.insert(make_pair(make_tuple((**gene1).id, (**gene2).id, contig1, contig2, breakpoint1, breakpoint2, direction1, direction2), fusion_t()));
@@ -454,10 +454,10 @@ unsigned int find_fusions(chimeric_alignments_t& chimeric_alignments, fusions_t&
 		} else {
 			fusion->second.spliced1 = fusion->second.exonic1 &&
 			                          fusion->second.gene1->strand == fusion->second.predicted_strand1 &&
-			                          is_breakpoint_spliced(fusion->second.gene1, fusion->second.direction1, fusion->second.breakpoint1, exon_annotation_index);
+			                          is_breakpoint_spliced(fusion->second.gene1, fusion->second.direction1, fusion->second.breakpoint1);
 			fusion->second.spliced2 = fusion->second.exonic2 &&
 			                          fusion->second.gene2->strand == fusion->second.predicted_strand2 &&
-			                          is_breakpoint_spliced(fusion->second.gene2, fusion->second.direction2, fusion->second.breakpoint2, exon_annotation_index);
+			                          is_breakpoint_spliced(fusion->second.gene2, fusion->second.direction2, fusion->second.breakpoint2);
 		}
 
 		// predict which gene makes the 5' end from strands or splice-sites or gene orientations
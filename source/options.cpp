@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <libgen.h>
@@ -10,6 +11,7 @@
 #include <unordered_map>
 #include "common.hpp"
 #include "annotation.hpp"
+#include "assembly.hpp"
 #include "options.hpp"
 
 using namespace std;
@@ -47,6 +49,17 @@ bool output_directory_exists(const string& output_file) {
 	return result;
 }
 
+// CRAM files are recognized by their magic number, because the file extension is not mandatory
+bool is_cram_file(const string& file_path) {
+	FILE* file = fopen(file_path.c_str(), "rb");
+	if (file == NULL)
+		return false;
+	char magic[4];
+	bool result = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, "CRAM", sizeof(magic)) == 0;
+	fclose(file);
+	return result;
+}
+
 bool validate_int(const char* optarg, int& value, const int min_value, const int max_value) {
 	if (!str_to_int(optarg, value))
 		return false;
@@ -101,6 +114,10 @@ options_t get_default_options() {
 	options.max_itd_length = 100;
 	options.min_itd_allele_fraction = 0.07;
 	options.min_itd_support = 10;
+	options.threads = 1;
+	options.sharded_reading = false;
+	options.targeted_coverage = false;
+	options.lazy_assembly_loading = false;
 
 	return options;
 }
@@ -139,9 +156,21 @@ void print_usage() {
 	     << wrap_help("-g FILE", "GTF file with gene annotation. The file may be gzip-compressed.")
 	     << wrap_help("-G GTF_FEATURES", "Comma-/space-separated list of names of GTF features.\n"
 	                  "Default: " + default_options.gtf_features)
+	     << wrap_help("-N FILE", "Cache file for the annotation given via -g. If the file does "
+	                  "not exist or was made from a different GTF file or different GTF features, "
+	                  "the GTF file is parsed and the cache file is (re-)written. Otherwise, the "
+	                  "annotation is loaded from the cache file, which is much faster.")
 	     << wrap_help("-a FILE", "FastA file with genome sequence (assembly). "
 	                  "The file may be gzip-compressed. An index with the file extension .fai "
-	                  "must exist only if CRAM files are processed.")
+	                  "must exist only if CRAM files are processed. Alternatively, an assembly "
+	                  "cache file made with -W can be given.")
+	     << wrap_help("-W FILE", "Convert the assembly given via -a to a cache file in 2-bit "
+	                  "encoding and exit. Loading the cache file via -a is much faster and takes "
+	                  "less memory than loading the FastA file. It cannot be used with CRAM files.")
+	     << wrap_help("-j", "Fetch the sequences of the assembly given via -a on demand instead of "
+	                  "loading all contigs at startup. This requires an index with the file "
+	                  "extension .fai (and .gzi for bgzip-compressed files). It saves memory, "
+	                  "when only a small part of the genome is covered, e.g., in targeted sequencing.")
 	     << wrap_help("-b FILE", "File containing blacklisted events (recurrent artifacts "
 	                  "and transcripts observed in healthy tissue).")
 	     << wrap_help("-k FILE", "File containing known/recurrent fusions. Some cancer "
@@ -246,6 +275,18 @@ void print_usage() {
 	                  "report an internal tandem duplication. Default: " + to_string(static_cast<long double>(default_options.min_itd_allele_fraction)))
 	     << wrap_help("-Z MIN_ITD_SUPPORTING_READS", "Required absolute number of supporting reads "
 	                  "to report an internal tandem duplication. Default: " + to_string(static_cast<long long unsigned int>(default_options.min_itd_support)))
+	     << wrap_help("-r FILE", "Only read alignments in the given regions and their mates from "
+	                  "the file passed via -x. The file must be coordinate-sorted and indexed. "
+	                  "The regions are given in BED format or as a list of genes or ranges, one "
+	                  "or more per line separated by tabs (e.g., a list of known fusions).")
+	     << wrap_help("-@ THREADS", "Number of threads to use for decompressing and "
+	                  "parsing the alignments, the assembly, and the annotation. Default: " + to_string(static_cast<long long unsigned int>(default_options.threads)))
+	     << wrap_help("-P", "Read the contigs of the file passed via -x in parallel using the "
+	                  "number of threads given via -@. The file must be coordinate-sorted and "
+	                  "indexed. This option cannot be combined with -r.")
+	     << wrap_help("-B", "Compute the coverage only in the vicinity of chimeric alignments "
+	                  "and on viral contigs by reading these regions from the file passed via -x "
+	                  "in a second pass. The file must be coordinate-sorted and indexed.")
 	     << wrap_help("-u", "Instead of performing duplicate marking itself, Arriba relies on "
 	                  "duplicate marking by a preceding program using the BAM_FDUP flag. This "
 	                  "makes sense when unique molecular identifiers (UMI) are used.")
@@ -276,7 +317,7 @@ options_t parse_arguments(int argc, char **argv) {
 	int c;
 	string junction_suffix(".junction");
 	unordered_map<char,unsigned int> duplicate_arguments;
-	const string valid_arguments = "c:x:d:g:G:o:O:t:p:a:b:k:s:i:v:f:E:S:m:L:H:D:R:A:M:K:V:F:U:Q:e:T:C:l:z:Z:uXIh";
+	const string valid_arguments = "c:x:d:g:G:N:o:O:t:p:a:W:jb:k:s:i:v:f:E:S:m:L:H:D:R:A:M:K:V:F:U:Q:e:T:C:l:z:Z:@:r:PBuXIh";
 	while ((c = getopt(argc, argv, valid_arguments.c_str())) != -1) {
 
 		// throw error if the same argument is specified more than once
@@ -329,12 +370,20 @@ options_t parse_arguments(int argc, char **argv) {
 				crash(access(options.protein_domains_file.c_str(), R_OK), "file not found/readable: " + options.protein_domains_file);
 				break;
 
+			case 'N':
+				options.annotation_cache_file = optarg;
+				crash(!output_directory_exists(options.annotation_cache_file), "parent directory of output file '" + options.annotation_cache_file + "' does not exist");
+				break;
 			case 'a':
 				options.assembly_file = optarg;
 				crash(access(options.assembly_file.c_str(), R_OK), "file not found/readable: " + options.assembly_file);
-				// when CRAM files are used, the FastA file must be indexed
-				if (options.rna_bam_file.size() >= 5 && options.rna_bam_file.substr(options.rna_bam_file.size()-5) == ".cram")
-					crash(access((options.assembly_file + ".fai").c_str(), R_OK), "index file not found/readable: " + options.assembly_file + ".fai");
+				break;
+			case 'W':
+				options.assembly_cache_file = optarg;
+				crash(!output_directory_exists(options.assembly_cache_file), "parent directory of output file '" + options.assembly_cache_file + "' does not exist");
+				break;
+			case 'j':
+				options.lazy_assembly_loading = true;
 				break;
 			case 'b':
 				options.blacklist_file = optarg;
@@ -440,6 +489,19 @@ options_t parse_arguments(int argc, char **argv) {
 			case 'Z':
 				crash(!validate_int(optarg, options.min_itd_support, 1), "argument to -" + ((char) c) + " must be an integer greater than 0");
 				break;
+			case 'r':
+				options.regions_file = optarg;
+				crash(access(options.regions_file.c_str(), R_OK), "file not found/readable: " + options.regions_file);
+				break;
+			case '@':
+				crash(!validate_int(optarg, options.threads, 1), "argument to -" + ((char) c) + " must be an integer greater than 0");
+				break;
+			case 'P':
+				options.sharded_reading = true;
+				break;
+			case 'B':
+				options.targeted_coverage = true;
+				break;
 			case 'u':
 				options.external_duplicate_marking = true;
 				break;
@@ -468,10 +530,21 @@ options_t parse_arguments(int argc, char **argv) {
 		print_usage();
 		crash(true, "no arguments given");
 	}
+	if (!options.assembly_cache_file.empty()) { // only the assembly is needed to make the cache file
+		crash(options.assembly_file.empty(), "missing mandatory option -a");
+		return options;
+	}
 	crash(options.rna_bam_file.empty(), "missing mandatory option -x");
 	crash(options.gene_annotation_file.empty(), "missing mandatory option -g");
 	crash(options.output_file.empty(), "missing mandatory option -o");
 	crash(options.assembly_file.empty(), "missing mandatory option -a");
+	// when CRAM files are used, htslib needs an indexed FastA file to decode them
+	if (is_cram_file(options.rna_bam_file) || !options.chimeric_bam_file.empty() && is_cram_file(options.chimeric_bam_file)) {
+		crash(is_assembly_cache(options.assembly_file), "an assembly cache file cannot be used with CRAM files (pass the FastA file via -a instead)");
+		crash(access((options.assembly_file + ".fai").c_str(), R_OK), "index file not found/readable: " + options.assembly_file + ".fai");
+	}
+	crash(options.lazy_assembly_loading && access((options.assembly_file + ".fai").c_str(), R_OK), "index file not found/readable: " + options.assembly_file + ".fai");
+	crash(options.sharded_reading && !options.regions_file.empty(), "options -P and -r are mutually exclusive");
 	crash(options.filters["blacklist"] && options.blacklist_file.empty(), "filter 'blacklist' enabled, but missing option -b (use '-f blacklist' if you want to disable the blacklist)");
 
 	return options;
@@ -63,6 +63,13 @@ struct options_t {
 	unsigned int max_itd_length;
 	float min_itd_allele_fraction;
 	unsigned int min_itd_support;
+	unsigned int threads;
+	bool sharded_reading;
+	bool targeted_coverage;
+	string regions_file;
+	string assembly_cache_file;
+	string annotation_cache_file;
+	bool lazy_assembly_loading;
 };
 
 options_t parse_arguments(int argc, char **argv);
@@ -43,7 +43,7 @@ void pileup_chimeric_alignments(vector<chimeric_alignments_t::iterator>& chimeri
 				if (read.start != breakpoint && read.end != breakpoint)
 					continue; // ignore split reads with slightly different breakpoints due to alternative alignments, since they would mess up the pileup
 
-		string read_sequence = (mate == SUPPLEMENTARY) ? (**chimeric_alignment).second[SPLIT_READ].sequence : read.sequence;
+		string read_sequence = ((mate == SUPPLEMENTARY) ? (**chimeric_alignment).second[SPLIT_READ].sequence : read.sequence).str();
 		if (reverse_complement)
 			read_sequence = dna_to_reverse_complement(read_sequence);
 
@@ -513,11 +513,11 @@ string gene_to_name(const gene_t gene, const contig_t contig, const position_t b
 
 		// append upstream flanking genes with distances to gene name
 		if (index_hit1 != gene_annotation_index[contig].rend()) {
-			for (gene_set_t::iterator gene = index_hit1->second.begin(); gene != index_hit1->second.end(); gene = upper_bound(index_hit1->second.begin(), index_hit1->second.end(), *gene)) {
+			for (gene_span_t::const_iterator gene = index_hit1->second.begin(); gene != index_hit1->second.end(); gene = upper_bound(index_hit1->second.begin(), index_hit1->second.end(), *gene)) {
 				if (!(**gene).is_dummy) {
 					if (!result.empty())
 						result += ",";
-					result += (**gene).name + "(" + to_string(static_cast<long long int>(breakpoint - (**gene).end)) + ")";
+					result += string((**gene).name) + "(" + to_string(static_cast<long long int>(breakpoint - (**gene).end)) + ")";
 				}
 			}
 		}
@@ -528,11 +528,11 @@ string gene_to_name(const gene_t gene, const contig_t contig, const position_t b
 
 		// append downstream flanking genes with distances to gene name
 		if (index_hit2 != gene_annotation_index[contig].end()) {
-			for (gene_set_t::iterator gene = index_hit2->second.begin(); gene != index_hit2->second.end(); gene = upper_bound(index_hit2->second.begin(), index_hit2->second.end(), *gene)) {
+			for (gene_span_t::const_iterator gene = index_hit2->second.begin(); gene != index_hit2->second.end(); gene = upper_bound(index_hit2->second.begin(), index_hit2->second.end(), *gene)) {
 				if (!(**gene).is_dummy) {
 					if (!result.empty())
 						result += ",";
-					result += (**gene).name + "(" + to_string(static_cast<long long int>((**gene).start - breakpoint)) + ")";
+					result += string((**gene).name) + "(" + to_string(static_cast<long long int>((**gene).start - breakpoint)) + ")";
 				}
 			}
 		}
@@ -640,13 +640,12 @@ string get_fusion_site(const gene_t gene, const bool spliced, const bool exonic,
 		site = "intergenic";
 	} else if (exonic) {
 		// re-annotate exonic breakpoints, because internally a read that overlaps even just partially with an exon is annotated as exonic
-		exon_set_t exons;
-		get_annotation_by_coordinate(contig, breakpoint, breakpoint, exons, exon_annotation_index);
+		exon_span_t exons = get_annotation_at_position(contig, breakpoint, exon_annotation_index);
 		bool has_overlapping_exon = false;
 		bool is_utr = true;
 		unsigned int is_3_end = 0;
 		unsigned int is_5_end = 0;
-		for (exon_set_t::iterator exon = exons.begin(); exon != exons.end(); ++exon) {
+		for (exon_span_t::const_iterator exon = exons.begin(); exon != exons.end(); ++exon) {
 			if ((**exon).gene == gene) {
 				has_overlapping_exon = true;
 				if ((**exon).coding_region_start <= breakpoint && (**exon).coding_region_end >= breakpoint)
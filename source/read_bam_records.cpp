@@ -0,0 +1,225 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "sam.h"
+#include "common.hpp"
+#include "read_bam_records.hpp"
+
+using namespace std;
+
+bool bam_record_batch_queue_t::try_push(bam_record_batch_t* batch) {
+	unsigned int current_tail = tail.load(memory_order_relaxed);
+	unsigned int next_tail = (current_tail + 1) % slots.size();
+	if (next_tail == head.load(memory_order_acquire))
+		return false; // queue is full
+	slots[current_tail] = batch;
+	tail.store(next_tail, memory_order_release);
+	return true;
+}
+
+bool bam_record_batch_queue_t::try_pop(bam_record_batch_t*& batch) {
+	unsigned int current_head = head.load(memory_order_relaxed);
+	if (current_head == tail.load(memory_order_acquire))
+		return false; // queue is empty
+	batch = slots[current_head];
+	head.store((current_head + 1) % slots.size(), memory_order_release);
+	return true;
+}
+
+// the fences order the update of head/tail and the check of <sleeping> against the reverse order in the sleeping thread,
+// so either the sleeping thread sees the update before it waits or the waking thread sees the sleeping thread
+void bam_record_batch_queue_t::wake_up() {
+	atomic_thread_fence(memory_order_seq_cst);
+	if (sleeping.load(memory_order_relaxed) > 0) {
+		lock_guard<mutex> lock(progress_mutex);
+		progress.notify_all();
+	}
+}
+
+void bam_record_batch_queue_t::push(bam_record_batch_t* batch) {
+	for (unsigned int spins = 0; spins < BAM_RECORD_BATCH_QUEUE_SPINS; ++spins) {
+		if (try_push(batch)) {
+			wake_up();
+			return;
+		}
+		this_thread::yield();
+	}
+	unique_lock<mutex> lock(progress_mutex);
+	sleeping++;
+	atomic_thread_fence(memory_order_seq_cst);
+	while (!try_push(batch))
+		progress.wait(lock);
+	sleeping--;
+	lock.unlock();
+	wake_up();
+}
+
+bam_record_batch_t* bam_record_batch_queue_t::pop() {
+	bam_record_batch_t* batch;
+	for (unsigned int spins = 0; spins < BAM_RECORD_BATCH_QUEUE_SPINS; ++spins) {
+		if (try_pop(batch)) {
+			wake_up();
+			return batch;
+		}
+		this_thread::yield();
+	}
+	unique_lock<mutex> lock(progress_mutex);
+	sleeping++;
+	atomic_thread_fence(memory_order_seq_cst);
+	while (!try_pop(batch))
+		progress.wait(lock);
+	sleeping--;
+	lock.unlock();
+	wake_up();
+	return batch;
+}
+
+bam_record_reader_t::bam_record_reader_t(samFile* bam_file, bam_hdr_t* bam_header, hts_itr_t* iterator):
+	bam_file(bam_file),
+	bam_header(bam_header),
+	iterator(iterator),
+	batches(BAM_RECORD_BATCHES_IN_FLIGHT),
+	filled_batches(BAM_RECORD_BATCHES_IN_FLIGHT),
+	free_batches(BAM_RECORD_BATCHES_IN_FLIGHT) {
+
+	// allocate all batches up front and hand them to the reader thread
+	for (vector<bam_record_batch_t>::iterator batch = batches.begin(); batch != batches.end(); ++batch) {
+		batch->records.resize(BAM_RECORDS_PER_BATCH);
+		for (vector<bam1_t*>::iterator bam_record = batch->records.begin(); bam_record != batch->records.end(); ++bam_record) {
+			*bam_record = bam_init1();
+			crash(*bam_record == NULL, "failed to allocate memory");
+		}
+		free_batches.push(&(*batch));
+	}
+
+	reader_thread = thread(read_batches, this);
+}
+
+bam_record_reader_t::~bam_record_reader_t() {
+	reader_thread.join();
+	for (vector<bam_record_batch_t>::iterator batch = batches.begin(); batch != batches.end(); ++batch)
+		for (vector<bam1_t*>::iterator bam_record = batch->records.begin(); bam_record != batch->records.end(); ++bam_record)
+			bam_destroy1(*bam_record);
+}
+
+void bam_record_reader_t::read_batches(bam_record_reader_t* reader) {
+	bool last = false;
+	while (!last) {
+		bam_record_batch_t* batch = reader->free_batches.pop();
+		batch->size = 0;
+		while (batch->size < batch->records.size()) {
+			if (reader->iterator == NULL)
+				batch->sam_read1_status = sam_read1(reader->bam_file, reader->bam_header, batch->records[batch->size]);
+			else
+				batch->sam_read1_status = sam_itr_next(reader->bam_file, reader->iterator, batch->records[batch->size]);
+			if (batch->sam_read1_status < 0)
+				break;
+			batch->size++;
+		}
+		last = batch->last = batch->size < batch->records.size(); // end of file or error
+		reader->filled_batches.push(batch);
+	}
+}
+
+bam_record_batch_t* bam_record_reader_t::next_batch() {
+	return filled_batches.pop();
+}
+
+void bam_record_reader_t::recycle_batch(bam_record_batch_t* batch) {
+	free_batches.push(batch);
+}
+
+bam_record_pool_t::~bam_record_pool_t() {
+	for (vector<bam1_t*>::iterator bam_record = free_records.begin(); bam_record != free_records.end(); ++bam_record)
+		bam_destroy1(*bam_record);
+}
+
+bam1_t* bam_record_pool_t::acquire() {
+	if (free_records.empty()) {
+		bam1_t* bam_record = bam_init1();
+		crash(bam_record == NULL, "failed to allocate memory");
+		return bam_record;
+	} else {
+		bam1_t* bam_record = free_records.back();
+		free_records.pop_back();
+		return bam_record;
+	}
+}
+
+void bam_record_pool_t::release(bam1_t* bam_record) {
+	if (free_records.size() < peak_pending_records + reserve)
+		free_records.push_back(bam_record);
+	else
+		bam_destroy1(bam_record); // pool is full
+}
+
+void bam_record_pool_t::update_pending_records(const size_t pending_records) {
+	if (pending_records > peak_pending_records) {
+		peak_pending_records = pending_records;
+		free_records.reserve(peak_pending_records + reserve);
+	}
+}
+
+bam_record_spill_file_t::~bam_record_spill_file_t() {
+	if (file != NULL)
+		fclose(file);
+}
+
+long int bam_record_spill_file_t::write(const char* key, const uint32_t key_length, const bam1_t* bam_record) {
+	if (file == NULL) {
+		file = tmpfile();
+		crash(file == NULL, "failed to create temporary file");
+	}
+	crash(fseek(file, 0, SEEK_END) != 0, "failed to seek in temporary file");
+	long int offset = ftell(file);
+	crash(fwrite(&key_length, sizeof(key_length), 1, file) != 1 ||
+	      fwrite(key, 1, key_length, file) != key_length ||
+	      fwrite(&bam_record->core, sizeof(bam_record->core), 1, file) != 1 ||
+	      fwrite(&bam_record->l_data, sizeof(bam_record->l_data), 1, file) != 1 ||
+	      fwrite(bam_record->data, 1, bam_record->l_data, file) != (size_t) bam_record->l_data,
+	      "failed to write to temporary file");
+	records++;
+	return offset;
+}
+
+void bam_record_spill_file_t::read(const long int offset, string& key, bam1_t* bam_record) {
+	crash(fseek(file, offset, SEEK_SET) != 0, "failed to seek in temporary file");
+	uint32_t key_length;
+	crash(fread(&key_length, sizeof(key_length), 1, file) != 1, "failed to read from temporary file");
+	key.resize(key_length);
+	int l_data;
+	crash(fread(&key[0], 1, key_length, file) != key_length ||
+	      fread(&bam_record->core, sizeof(bam_record->core), 1, file) != 1 ||
+	      fread(&l_data, sizeof(l_data), 1, file) != 1,
+	      "failed to read from temporary file");
+	if (bam_record->m_data < (uint32_t) l_data) { // enlarge data buffer of record
+		uint8_t* data = (uint8_t*) realloc(bam_record->data, l_data);
+		crash(data == NULL, "failed to allocate memory");
+		bam_record->data = data;
+		bam_record->m_data = l_data;
+	}
+	bam_record->l_data = l_data;
+	crash(fread(bam_record->data, 1, l_data, file) != (size_t) l_data, "failed to read from temporary file");
+}
+
+void bam_record_spill_file_t::release() {
+	if (--records == 0) // all records have been read back => start over at the beginning of the file to keep it small
+		crash(fflush(file) != 0 || ftruncate(fileno(file), 0) != 0, "failed to truncate temporary file");
+}
+
+bool is_coordinate_sorted(bam_hdr_t* bam_header) {
+	const char* header_text = sam_hdr_str(bam_header);
+	if (header_text == NULL || strncmp(header_text, "@HD", 3) != 0)
+		return false;
+	const char* end_of_line = strchr(header_text, '\n');
+	string hd_line = (end_of_line == NULL) ? string(header_text) : string(header_text, end_of_line - header_text);
+	return hd_line.find("\tSO:coordinate") != string::npos;
+}
@@ -0,0 +1,112 @@
+#ifndef READ_BAM_RECORDS_H
+#define READ_BAM_RECORDS_H 1
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sam.h"
+
+using namespace std;
+
+// number of BAM records which are handed from the reader thread to the consumer in one go
+const unsigned int BAM_RECORDS_PER_BATCH = 1000;
+
+// number of batches the reader thread may read ahead of the consumer
+const unsigned int BAM_RECORD_BATCHES_IN_FLIGHT = 64;
+
+struct bam_record_batch_t {
+	vector<bam1_t*> records;
+	unsigned int size; // number of valid records in <records>
+	bool last; // set for the final batch of the file
+	int sam_read1_status; // status of the last call to sam_read1()
+};
+
+// number of unsuccessful attempts to push to/pop from a queue before the thread goes to sleep
+const unsigned int BAM_RECORD_BATCH_QUEUE_SPINS = 100;
+
+// bounded lock-free queue with a single producer and a single consumer
+// push() and pop() spin briefly and then sleep until the other side has made progress,
+// such that a waiting thread does not take CPU time away from the upstream program
+class bam_record_batch_queue_t {
+	public:
+		bam_record_batch_queue_t(const unsigned int capacity): slots(capacity+1), head(0), tail(0), sleeping(0) {};
+		bool try_push(bam_record_batch_t* batch);
+		bool try_pop(bam_record_batch_t*& batch);
+		void push(bam_record_batch_t* batch);
+		bam_record_batch_t* pop();
+	private:
+		void wake_up();
+		vector<bam_record_batch_t*> slots;
+		atomic<unsigned int> head; // next slot to pop from (only modified by the consumer)
+		atomic<unsigned int> tail; // next slot to push to (only modified by the producer)
+		atomic<unsigned int> sleeping; // number of threads waiting on <progress>
+		mutex progress_mutex;
+		condition_variable progress;
+};
+
+// reads BAM records in a dedicated thread, such that the upstream program (e.g., STAR writing to a pipe)
+// is not throttled by the processing of the records
+// the batches cycle between the reader thread and the consumer via two queues:
+// filled batches go to the consumer, consumed batches go back to the reader for reuse
+class bam_record_reader_t {
+	public:
+		// if an iterator is given, only the records returned by the iterator are read
+		bam_record_reader_t(samFile* bam_file, bam_hdr_t* bam_header, hts_itr_t* iterator = NULL);
+		~bam_record_reader_t();
+		// blocks until the next batch is available; the final batch has the flag <last> set
+		bam_record_batch_t* next_batch();
+		// give a consumed batch back to the reader
+		// records the consumer wants to keep must be replaced with freshly allocated ones
+		void recycle_batch(bam_record_batch_t* batch);
+	private:
+		static void read_batches(bam_record_reader_t* reader);
+		samFile* bam_file;
+		bam_hdr_t* bam_header;
+		hts_itr_t* iterator;
+		vector<bam_record_batch_t> batches;
+		bam_record_batch_queue_t filled_batches;
+		bam_record_batch_queue_t free_batches;
+		thread reader_thread;
+};
+
+// recycles BAM records to avoid allocating and freeing memory for every record
+// records which are handed back to the pool keep their data buffer, such that sam_read1() can reuse it
+// the pool retains as many records as were pending at peak plus the given reserve and frees any excess records
+class bam_record_pool_t {
+	public:
+		bam_record_pool_t(const size_t reserve): reserve(reserve), peak_pending_records(0) { free_records.reserve(reserve); };
+		~bam_record_pool_t();
+		bam1_t* acquire();
+		void release(bam1_t* bam_record);
+		// inform the pool about the number of records which are currently held back (e.g., first mates awaiting their mates)
+		void update_pending_records(const size_t pending_records);
+	private:
+		vector<bam1_t*> free_records;
+		size_t reserve;
+		size_t peak_pending_records;
+};
+
+// temporary file to hold BAM records which must wait for a long time until their mate is read
+// each record is stored along with its key in a compact binary format
+class bam_record_spill_file_t {
+	public:
+		bam_record_spill_file_t(): file(NULL), records(0) {};
+		~bam_record_spill_file_t();
+		// returns the offset of the record in the file
+		long int write(const char* key, const uint32_t key_length, const bam1_t* bam_record);
+		void read(const long int offset, string& key, bam1_t* bam_record);
+		// mark a record as read back, once all records are read back, the file is truncated
+		void release();
+	private:
+		FILE* file;
+		unsigned long int records; // number of records which have not been read back yet
+};
+
+// returns true, if the header says that the records are sorted by coordinate
+bool is_coordinate_sorted(bam_hdr_t* bam_header);
+
+#endif /* READ_BAM_RECORDS_H */
@@ -1,21 +1,110 @@
 #include <algorithm>
+#include <atomic>
 #include <climits>
+#include <cstring>
 #include <iostream>
+#include <map>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "cram.h"
 #include "htrie_map.h"
 #include "sam.h"
 #include "annotation.hpp"
 #include "common.hpp"
+#include "filter_blacklisted_ranges.hpp"
+#include "read_compressed_file.hpp"
+#include "read_bam_records.hpp"
 #include "read_chimeric_alignments.hpp"
 #include "read_stats.hpp"
 
 using namespace std;
 
-typedef tsl::htrie_map<char,bam1_t*> collated_bam_records_t;
 typedef vector<contig_t> tid_to_contig_t;
 
+// the names of records are extended by the HI tag, so the buffer must be larger than the maximum length of a read name (254)
+const unsigned int MAX_READ_NAME_LENGTH = 256 + 21;
+
+// compose the name of a record from the read name and the HI tag to enable segregation of multi-mapping reads
+// the name is written to a fixed buffer to avoid allocating memory for every record
+unsigned int make_read_name(const bam1_t* bam_record, const int64_t hit_index, char* read_name) {
+	unsigned int length = bam_record->core.l_qname - 1 - bam_record->core.l_extranul; // l_qname includes the terminating NUL character(s)
+	memcpy(read_name, bam_get_qname(bam_record), length);
+	read_name[length++] = ',';
+	// append HI tag
+	uint64_t remainder = (hit_index < 0) ? -hit_index : hit_index;
+	if (hit_index < 0)
+		read_name[length++] = '-';
+	char digits[20];
+	unsigned int digit_count = 0;
+	do {
+		digits[digit_count++] = '0' + remainder % 10;
+		remainder /= 10;
+	} while (remainder > 0);
+	while (digit_count > 0)
+		read_name[length++] = digits[--digit_count];
+	read_name[length] = '\0';
+	return length;
+}
+
+// the HI tag is only read for records which are stored, because looking up aux tags is expensive
+int64_t get_hit_index(const bam1_t* bam_record) {
+	uint8_t* hi_tag = bam_aux_get(bam_record, "HI");
+	return (hi_tag != NULL) ? bam_aux2i(hi_tag) : 1;
+}
+
+// in coordinate-sorted input, the mate of a record is expected at the position given by mtid/mpos
+typedef pair<int32_t,hts_pos_t> bam_position_t; // tid as given in the BAM file (before conversion to our contig IDs) and position
+typedef multimap< bam_position_t,pair<bam1_t*,int32_t> > pending_mates_t; // first mates held in memory (and their tid as given in the BAM file) indexed by the position of their mate
+typedef multimap< bam_position_t,pair<long int,int32_t> > spilled_mates_t; // offsets of first mates in the spill file (and their tid as given in the BAM file) indexed by the position of their mate
+
+// a first mate waiting for its partner
+// in coordinate-sorted input, pending_mate points to the entry which frees the record, if the partner does not show up;
+// the entry is removed as soon as the partner is found, because the record is returned to the pool after classification
+struct collated_mate_t {
+	bam1_t* bam_record;
+	pending_mates_t::iterator pending_mate;
+};
+typedef tsl::htrie_map<char,collated_mate_t> collated_bam_records_t;
+
+// the key used to collate mates consists of the read name, the positions of both mates and, for secondary alignments, the HI tag
+const unsigned int MAX_COLLATION_KEY_LENGTH = 256 + 2 * (sizeof(int32_t) + sizeof(hts_pos_t)) + sizeof(int64_t);
+
+// compose the key under which a record waits for its mate
+// instead of reading the HI tag of every record, the hits of multi-mapping reads are segregated by the positions of the mates,
+// which are taken from the core of the record; the smaller position comes first, such that both mates yield the same key
+// different hits can have the same positions (e.g., when they differ only in the CIGAR string), so the HI tag is appended
+// for secondary alignments; a read has only one primary hit, so only primary alignments can do without the HI tag
+// in Chimeric.out.sam, the read name suffices, because it only contains unique hits
+// <tid> is the tid of the record as given in the BAM file (before conversion to our contig IDs)
+unsigned int make_collation_key(const bam1_t* bam_record, const int32_t tid, const bool separate_chimeric_bam_file, char* key) {
+	if (separate_chimeric_bam_file)
+		return make_read_name(bam_record, 1, key);
+	unsigned int length = bam_record->core.l_qname - 1 - bam_record->core.l_extranul; // l_qname includes the terminating NUL character(s)
+	memcpy(key, bam_get_qname(bam_record), length);
+	bam_position_t position(tid, bam_record->core.pos);
+	bam_position_t mate_position(bam_record->core.mtid, bam_record->core.mpos);
+	if (mate_position < position)
+		swap(position, mate_position);
+	memcpy(key + length, &position.first, sizeof(position.first)); length += sizeof(position.first);
+	memcpy(key + length, &position.second, sizeof(position.second)); length += sizeof(position.second);
+	memcpy(key + length, &mate_position.first, sizeof(mate_position.first)); length += sizeof(mate_position.first);
+	memcpy(key + length, &mate_position.second, sizeof(mate_position.second)); length += sizeof(mate_position.second);
+	if (bam_record->core.flag & BAM_FSECONDARY) {
+		int64_t hit_index = get_hit_index(bam_record);
+		memcpy(key + length, &hit_index, sizeof(hit_index)); length += sizeof(hit_index);
+	}
+	return length;
+}
+
+// in coordinate-sorted input, first mates whose mate is further away than this are moved to disk to save memory
+const hts_pos_t MAX_IN_MEMORY_MATE_DISTANCE = 100000;
+
+// sorted, non-overlapping regions (zero-based, end exclusive) by tid as given in the BAM file
+typedef vector< vector< pair<hts_pos_t,hts_pos_t> > > bam_regions_t;
+
 bool find_spanning_intron(const bam1_t* bam_record, const position_t gene1_end, const position_t gene2_start, unsigned int& cigar_op, position_t& read_pos) {
 
 	if (bam_record->core.n_cigar < 3)
@@ -59,9 +148,7 @@ void add_chimeric_alignment(mates_t& mates, const bam1_t* bam_record, const bool
 	alignment.contig = bam_record->core.tid;
 	alignment.supplementary = is_supplementary;
 	if (!is_supplementary) { // only keep sequence in memory, if this is not the supplementary alignment (because then it's already stored in the split-read)
-		alignment.sequence.resize(bam_record->core.l_qseq);
-		for (int i = 0; i < bam_record->core.l_qseq; ++i)
-			alignment.sequence[i] = seq_nt16_str[bam_seqi(bam_get_seq(bam_record), i)];
+		alignment.sequence.assign(bam_get_seq(bam_record), bam_record->core.l_qseq);
 	}
 
 	// read-through alignments need to be split into a split-read and a supplementary alignment
@@ -88,22 +175,22 @@ void add_chimeric_alignment(mates_t& mates, const bam1_t* bam_record, const bool
 	}
 }
 
-bool extract_read_through_alignment(chimeric_alignments_t& chimeric_alignments, const string& read_name, bam1_t* forward_mate, bam1_t* reverse_mate, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file) {
+// extract read-through alignments into <read_through_alignments>
+// the alignments must only be stored, if the read has not been stored as a chimeric alignment previously;
+// if <is_split_read> is set, the fragment only counts as a read-through fragment, if the alignments could be stored
+bool extract_read_through_alignment(mates_t& read_through_alignments, bool& is_split_read, bam1_t* forward_mate, bam1_t* reverse_mate, const gene_annotation_index_t& gene_annotation_index) {
 
 	// find out which read is on the forward strand and which on the reverse
 	if (get_strand(forward_mate) == REVERSE)
 		swap(forward_mate, reverse_mate);
 
 	// check if one mate maps inside the gene and the other outside
-	gene_set_t forward_mate_genes, reverse_mate_genes;
-	if (forward_mate != NULL)
-		get_annotation_by_coordinate(forward_mate->core.tid, forward_mate->core.pos, forward_mate->core.pos, forward_mate_genes, gene_annotation_index);
-	else
-		get_annotation_by_coordinate(reverse_mate->core.tid, reverse_mate->core.pos, reverse_mate->core.pos, forward_mate_genes, gene_annotation_index);
-	if (reverse_mate != NULL)
-		get_annotation_by_coordinate(reverse_mate->core.tid, bam_endpos(reverse_mate), bam_endpos(reverse_mate), reverse_mate_genes, gene_annotation_index);
-	else
-		get_annotation_by_coordinate(forward_mate->core.tid, bam_endpos(forward_mate), bam_endpos(forward_mate), reverse_mate_genes, gene_annotation_index);
+	gene_span_t forward_mate_genes = (forward_mate != NULL) ?
+		get_annotation_at_position(forward_mate->core.tid, forward_mate->core.pos, gene_annotation_index) :
+		get_annotation_at_position(reverse_mate->core.tid, reverse_mate->core.pos, gene_annotation_index);
+	gene_span_t reverse_mate_genes = (reverse_mate != NULL) ?
+		get_annotation_at_position(reverse_mate->core.tid, bam_endpos(reverse_mate), gene_annotation_index) :
+		get_annotation_at_position(forward_mate->core.tid, bam_endpos(forward_mate), gene_annotation_index);
 	gene_set_t common_genes;
 	combine_annotations(forward_mate_genes, reverse_mate_genes, common_genes, false);
 	if (common_genes.empty() && !(forward_mate_genes.empty() && reverse_mate_genes.empty())) { // mate1 and mate2 map to different genes => potential read-through fusion
@@ -133,55 +220,44 @@ bool extract_read_through_alignment(chimeric_alignments_t& chimeric_alignments,
 		if (forward_mate_has_intron &&
 		    (!reverse_mate_has_intron || forward_read_pos < reverse_mate->core.l_qseq - reverse_read_pos)) { // if both mates are clipped, use the one with the longer segment as anchor
 
-			// store read-through alignments, unless they are already stored as chimeric alignments
-			pair<chimeric_alignments_t::iterator,bool> mates = chimeric_alignments.insert(pair<string,mates_t>(read_name, mates_t()));
-			if (mates.second) { // insertion succeeded => the alignments have not been stored previously
+			// make split read and supplementary from forward mate
+			add_chimeric_alignment(read_through_alignments, forward_mate, false, forward_cigar_op+1, CLIP_START);
+			add_chimeric_alignment(read_through_alignments, forward_mate, true/*supplementary*/, forward_cigar_op-1, CLIP_END);
 
-				// make split read and supplementary from forward mate
-				add_chimeric_alignment(mates.first->second, forward_mate, false, forward_cigar_op+1, CLIP_START);
-				add_chimeric_alignment(mates.first->second, forward_mate, true/*supplementary*/, forward_cigar_op-1, CLIP_END);
-
-				if (reverse_mate != NULL) { // paired-end
-					if (reverse_mate_has_intron) // reverse mate overlaps with breakpoint => clip it
-						add_chimeric_alignment(mates.first->second, reverse_mate, false, reverse_cigar_op+1, CLIP_START);
-					else // reverse mate overlaps with forward mate, but not with breakpoint => add it as is
-						add_chimeric_alignment(mates.first->second, reverse_mate);
-				}
-
-				return true;
+			if (reverse_mate != NULL) { // paired-end
+				if (reverse_mate_has_intron) // reverse mate overlaps with breakpoint => clip it
+					add_chimeric_alignment(read_through_alignments, reverse_mate, false, reverse_cigar_op+1, CLIP_START);
+				else // reverse mate overlaps with forward mate, but not with breakpoint => add it as is
+					add_chimeric_alignment(read_through_alignments, reverse_mate);
 			}
 
-		} else if (reverse_mate_has_intron) {
+			is_split_read = true;
+			return true;
 
-			// add read-through alignments, unless they are already stored as chimeric alignments
-			pair<chimeric_alignments_t::iterator,bool> mates = chimeric_alignments.insert(pair<string,mates_t>(read_name, mates_t()));
-			if (mates.second) { // insertion succeeded => the alignments have not been stored previously
+		} else if (reverse_mate_has_intron) {
 
-				// make split read and supplementary from reverse mate
-				add_chimeric_alignment(mates.first->second, reverse_mate, true/*supplementary*/, reverse_cigar_op+1, CLIP_START);
-				add_chimeric_alignment(mates.first->second, reverse_mate, false, reverse_cigar_op-1, CLIP_END);
-	
-				if (forward_mate != NULL) { // paired-end
-					if (forward_mate_has_intron) // forward mate overlaps with breakpoints => clip it at the end
-						add_chimeric_alignment(mates.first->second, forward_mate, false, forward_cigar_op-1, CLIP_END);
-					else // forward mate overlaps with reverse mate, but not with breakpoint => add it as is
-						add_chimeric_alignment(mates.first->second, forward_mate);
-				}
+			// make split read and supplementary from reverse mate
+			add_chimeric_alignment(read_through_alignments, reverse_mate, true/*supplementary*/, reverse_cigar_op+1, CLIP_START);
+			add_chimeric_alignment(read_through_alignments, reverse_mate, false, reverse_cigar_op-1, CLIP_END);
 
-				return true;
+			if (forward_mate != NULL) { // paired-end
+				if (forward_mate_has_intron) // forward mate overlaps with breakpoints => clip it at the end
+					add_chimeric_alignment(read_through_alignments, forward_mate, false, forward_cigar_op-1, CLIP_END);
+				else // forward mate overlaps with reverse mate, but not with breakpoint => add it as is
+					add_chimeric_alignment(read_through_alignments, forward_mate);
 			}
 
+			is_split_read = true;
+			return true;
+
 		// check for possibility (2) => the mates must be contained within different genes
 		} else if (forward_mate != NULL && reverse_mate != NULL && // paired-end
 		           reverse_mate->core.pos   >= reverse_gene_start &&
 		           bam_endpos(forward_mate) <= forward_gene_end) {
 
-			// add read-through alignments, unless they are already stored as chimeric alignments
-			pair<chimeric_alignments_t::iterator,bool> mates = chimeric_alignments.insert(pair<string,mates_t>(read_name, mates_t()));
-			if (mates.second) { // insertion succeeded => the alignments have not been stored previously
-				add_chimeric_alignment(mates.first->second, forward_mate);
-				add_chimeric_alignment(mates.first->second, reverse_mate);
-			}
+			add_chimeric_alignment(read_through_alignments, forward_mate);
+			add_chimeric_alignment(read_through_alignments, reverse_mate);
+			is_split_read = false;
 			return true;
 
 		} // else possibility (3)
@@ -208,6 +284,69 @@ bool clipped_sequence_is_adapter(const bam1_t* mate1, const bam1_t* mate2) {
 	return false;
 }
 
+// bit masks of matching/mismatching bases between a read and the reference (bit i represents base i)
+typedef vector<uint64_t> base_mask_t;
+
+// compare <length> bases of a read and the reference (16 at a time with SSE2) and record the result in bit masks
+void compare_bases(const char* read_sequence, const char* contig_sequence, const unsigned int length, base_mask_t& matching_bases, base_mask_t& mismatching_bases) {
+	fill(matching_bases.begin(), matching_bases.end(), 0);
+	unsigned int i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= length; i += 16) { // 16 bases never cross the boundary of a 64-bit word
+		__m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (read_sequence + i)), _mm_loadu_si128((const __m128i*) (contig_sequence + i)));
+		matching_bases[i/64] |= ((uint64_t) (unsigned int) _mm_movemask_epi8(equal)) << (i % 64);
+	}
+#endif
+	for (; i < length; ++i)
+		if (read_sequence[i] == contig_sequence[i])
+			matching_bases[i/64] |= ((uint64_t) 1) << (i % 64);
+	for (unsigned int word = 0; word < matching_bases.size(); ++word)
+		mismatching_bases[word] = ~matching_bases[word];
+	if (length % 64 != 0)
+		mismatching_bases[length/64] &= (((uint64_t) 1) << (length % 64)) - 1; // bits beyond the end of the read are not mismatches
+}
+
+// get the bits of a word of a bit mask which lie within the range [from, to)
+uint64_t get_bits_in_range(const base_mask_t& bits, const unsigned int word, const unsigned int from, const unsigned int to) {
+	uint64_t result = bits[word];
+	if (from > word * 64)
+		result &= ~((uint64_t) 0) << (from - word * 64);
+	if (to < (word + 1) * 64)
+		result &= (((uint64_t) 1) << (to - word * 64)) - 1;
+	return result;
+}
+
+// number of set bits in the range [from, to)
+unsigned int count_bits(const base_mask_t& bits, const unsigned int from, const unsigned int to) {
+	unsigned int count = 0;
+	if (from < to)
+		for (unsigned int word = from / 64; word <= (to - 1) / 64; ++word)
+			count += __builtin_popcountll(get_bits_in_range(bits, word, from, to));
+	return count;
+}
+
+// position of the lowest set bit in the range [from, to) or <to>, if there is none
+int find_next_bit(const base_mask_t& bits, const int from, const int to) {
+	if (from < to)
+		for (unsigned int word = from / 64; word <= (unsigned int) (to - 1) / 64; ++word) {
+			uint64_t word_bits = get_bits_in_range(bits, word, from, to);
+			if (word_bits != 0)
+				return word * 64 + __builtin_ctzll(word_bits);
+		}
+	return to;
+}
+
+// position of the highest set bit in the range [from, to) or <from>-1, if there is none
+int find_previous_bit(const base_mask_t& bits, const int from, const int to) {
+	if (from < to)
+		for (int word = (to - 1) / 64; word >= from / 64; --word) {
+			uint64_t word_bits = get_bits_in_range(bits, word, from, to);
+			if (word_bits != 0)
+				return word * 64 + 63 - __builtin_clzll(word_bits);
+		}
+	return from - 1;
+}
+
 // STAR is bad at aligning internal tandem duplications
 // => if we see a clipped read, check manually if it can be aligned as a tandem duplication
 bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly, const unsigned int max_itd_length, alignment_t& tandem_alignment) {
@@ -256,7 +395,7 @@ bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly,
 	// make sure assembly sequence is available
 	if (assembly.find(bam_record->core.tid) == assembly.end())
 		return false; // contig sequence unavailable and thus no way to make an alignment
-	const string& contig_sequence = assembly.at(bam_record->core.tid);
+	const contig_sequence_t& contig_sequence = assembly.at(bam_record->core.tid);
 	if (alignment_window_end + max_duplication_length + clipped_sequence_length + 1 >= contig_sequence.size() ||
 	    alignment_window_start <= (int) (max_duplication_length + clipped_sequence_length + 1))
 		return false; // ignore alignments close to contig boundaries to avoid array out-of-bounds errors
@@ -264,8 +403,7 @@ bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly,
 	// convert read sequence to string
 	string clipped_sequence;
 	clipped_sequence.resize(clipped_sequence_length);
-	for (unsigned int i = 0; i < clipped_sequence_length; ++i)
-		clipped_sequence[i] = seq_nt16_str[bam_seqi(bam_get_seq(bam_record), clipped_sequence_position + i)];
+	decode_nt16_sequence(bam_get_seq(bam_record), clipped_sequence_position, clipped_sequence_length, &clipped_sequence[0]);
 
 
 	// first, try extended alignment to check if read was clipped prematurely by STAR (often due to a cluster of SNPs)
@@ -279,30 +417,37 @@ bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly,
 		return false; // the split read can simply be extended linearly, no need to try a tandem alignment
 
 	// try to align clipped sequence in a window of size <max_duplication_length>
+	// the bases are compared in bulk and the alignment is evaluated on bit masks of matching/mismatching bases
+	const string window_sequence = contig_sequence.substr(alignment_window_start, alignment_window_end - alignment_window_start + clipped_sequence_length);
+	base_mask_t matching_bases((clipped_sequence_length + 63) / 64);
+	base_mask_t mismatching_bases(matching_bases.size());
+	// mismatches are only counted outside the non-template bases at the beginning of the tandem alignment
+	const int counted_start = (alignment_direction == +1) ? max_non_template_bases : 0;
+	const int counted_end = (alignment_direction == +1) ? clipped_sequence_length : clipped_sequence_length - max_non_template_bases;
 	for (int contig_pos = alignment_window_start; contig_pos <= alignment_window_end; ++contig_pos) {
 
+		compare_bases(clipped_sequence.c_str(), window_sequence.c_str() + (contig_pos - alignment_window_start), clipped_sequence_length, matching_bases, mismatching_bases);
+
 		// align at given position and abort when too many mismatches have been encountered
-		unsigned int matches = 0;
+		// => find the mismatch which exceeds <max_mismatches> in the direction of alignment
+		int aligned_start = 0; // the range [aligned_start, aligned_end) of the read is aligned before abortion
+		int aligned_end = clipped_sequence_length;
 		unsigned int mismatches = 0;
-		tandem_alignment.start = contig_sequence.size();
-		tandem_alignment.end = -1;
-		for (unsigned int i = 0; i < clipped_sequence_length; i++) {
-			int read_pos = (alignment_direction == +1) ? i : clipped_sequence_length - 1 - i;
-			if (contig_sequence[contig_pos+read_pos] == clipped_sequence[read_pos]) {
-				matches++;
-				if (contig_pos + read_pos < tandem_alignment.start)
-					tandem_alignment.start = contig_pos + read_pos;
-				if (contig_pos + read_pos > tandem_alignment.end)
-					tandem_alignment.end = contig_pos + read_pos;
-			} else if (i >= max_non_template_bases) {
-				mismatches++;
-				if (mismatches > max_mismatches)
-					break;
-			}
+		if (alignment_direction == +1) {
+			for (int read_pos = find_next_bit(mismatching_bases, counted_start, counted_end); read_pos < counted_end && mismatches <= max_mismatches; read_pos = find_next_bit(mismatching_bases, read_pos + 1, counted_end))
+				if (++mismatches > max_mismatches)
+					aligned_end = read_pos + 1;
+		} else {
+			for (int read_pos = find_previous_bit(mismatching_bases, counted_start, counted_end); read_pos >= counted_start && mismatches <= max_mismatches; read_pos = find_previous_bit(mismatching_bases, counted_start, read_pos))
+				if (++mismatches > max_mismatches)
+					aligned_start = read_pos;
 		}
+		unsigned int matches = count_bits(matching_bases, aligned_start, aligned_end);
 
 		// return tandem alignment as result if it has sufficient quality
 		if (matches >= min_alignment_length || matches + mismatches == clipped_sequence_length) {
+			tandem_alignment.start = (matches > 0) ? contig_pos + find_next_bit(matching_bases, aligned_start, aligned_end) : contig_sequence.size();
+			tandem_alignment.end = (matches > 0) ? contig_pos + find_previous_bit(matching_bases, aligned_start, aligned_end) : -1;
 			tandem_alignment.strand = get_strand(bam_record);
 			tandem_alignment.first_in_pair = bam_record->core.flag & BAM_FREAD1;
 			tandem_alignment.contig = bam_record->core.tid;
@@ -310,9 +455,7 @@ bool is_tandem_duplication(const bam1_t* bam_record, const assembly_t& assembly,
 			                                 clipped_start  && get_strand(bam_record) == FORWARD ||
 			                                 !clipped_start && get_strand(bam_record) == REVERSE;
 			if (!tandem_alignment.supplementary) { // only keep sequence in memory, if this is not the supplementary alignment (because then it's already stored in the split-read)
-				tandem_alignment.sequence.resize(bam_record->core.l_qseq);
-				for (int i = 0; i < bam_record->core.l_qseq; ++i)
-					tandem_alignment.sequence[i] = seq_nt16_str[bam_seqi(bam_get_seq(bam_record), i)];
+				tandem_alignment.sequence.assign(bam_get_seq(bam_record), bam_record->core.l_qseq);
 			}
 			// construct CIGAR string
 			uint32_t clip_left = (clipped_start) ? 0 : bam_record->core.l_qseq - clipped_sequence_length;
@@ -498,8 +641,10 @@ unsigned int remove_malformed_alignments(chimeric_alignments_t& chimeric_alignme
 
 		malformed_alignment:
 			malformed_count++;
-			chimeric_alignment = chimeric_alignments.erase(chimeric_alignment);
+			chimeric_alignment->second.clear(); // mark for removal
+			++chimeric_alignment;
 	}
+	chimeric_alignments.erase_empty_mates();
 
 	return malformed_count;
 }
@@ -520,6 +665,17 @@ bool is_clipped_at_correct_end(const bam1_t* bam_record) {
 	return clipped_cigar == BAM_CSOFT_CLIP || clipped_cigar == BAM_CHARD_CLIP;
 }
 
+// cheap check of the CIGAR string, which precedes the expensive checks for ITDs and SA tags
+// alignments which are not clipped at either end can neither be split reads nor tandem duplications
+bool is_clipped(const bam1_t* bam_record) {
+	if (bam_record == NULL || bam_record->core.n_cigar == 0)
+		return false;
+	uint32_t first_cigar_op = bam_cigar_op(bam_get_cigar(bam_record)[0]);
+	uint32_t last_cigar_op = bam_cigar_op(bam_get_cigar(bam_record)[bam_record->core.n_cigar-1]);
+	return first_cigar_op == BAM_CSOFT_CLIP || first_cigar_op == BAM_CHARD_CLIP ||
+	       last_cigar_op == BAM_CSOFT_CLIP || last_cigar_op == BAM_CHARD_CLIP;
+}
+
 // viral reads are only counted if their alignment is of high quality
 // doing so yields more accurate quantification of viral expression, because it eliminates alignment artifacts
 bool is_pristine_alignment(const bam1_t* bam_record) {
@@ -534,8 +690,8 @@ bool is_pristine_alignment(const bam1_t* bam_record) {
 	// get sequence of read as string to look for tandem repeats
 	string sequence;
 	sequence.resize(bam_record->core.l_qseq);
-	for (int i = 0; i < bam_record->core.l_qseq; ++i)
-		sequence[i] = seq_nt16_str[bam_seqi(bam_get_seq(bam_record), i)];
+	if (!sequence.empty())
+		decode_nt16_sequence(bam_get_seq(bam_record), 0, sequence.size(), &sequence[0]);
 
 	// walk over sequence looking for tandem repeats of dimers or triplets
 	for (unsigned int i = 2, repeat = 0, count = 1; i + 2 < sequence.size(); i += 2) {
@@ -556,16 +712,715 @@ bool is_pristine_alignment(const bam1_t* bam_record) {
 	return true;
 }
 
-unsigned int read_chimeric_alignments(const string& bam_file_path, const assembly_t& assembly, const string& assembly_file_path, chimeric_alignments_t& chimeric_alignments, unsigned long int& mapped_reads, vector<unsigned long int>& mapped_viral_reads_by_contig, coverage_t& coverage, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const string& viral_contigs, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file, const bool is_rna_bam_file, const bool external_duplicate_marking, const unsigned int max_itd_length) {
+// types of fragments which are handed from the reader to the worker threads
+enum fragment_type_t { FRAGMENT_SUPPLEMENTARY_FROM_CHIMERIC_FILE, FRAGMENT_SUPPLEMENTARY, FRAGMENT_DISCORDANT_MATE, FRAGMENT_MATES };
+
+// a fragment holds one or two BAM records (depending on whether the data is paired-end and the type of the fragment)
+// the worker threads classify fragments and store the result of classification in the fragment
+// the results are merged into the chimeric alignments sequentially in the order of the BAM records
+struct fragment_t {
+	fragment_type_t type;
+	string read_name; // empty for FRAGMENT_MATES until classification found something to store
+	bam1_t* mate1; // the BAM record which completed the fragment
+	bam1_t* mate2; // the previously seen mate (NULL for single-end data)
+	// results of classification
+	mates_t chimeric_alignments;
+	mates_t tandem_alignments;
+	bool is_chimeric; // whether the fragment counts as a chimeric read for the sanity check
+	bool is_read_through_candidate; // <chimeric_alignments> must only be stored, if the read name is not yet present
+	bool is_split_read; // a read-through fragment is only counted as such, if it is a split read and could be stored
+	bool is_malformed;
+	bool is_pristine_viral_mate1;
+	bool is_pristine_viral_mate2;
+	bool adds_to_coverage;
+	bool is_coverage_deferred; // whether the fragment is added to the coverage when it is merged rather than during classification
+};
+typedef vector<fragment_t> fragments_t;
+
+// number of fragments each thread classifies in one go
+const unsigned int FRAGMENTS_PER_THREAD = 10000;
+
+// data needed to classify and merge fragments, which is shared by all streams of records
+struct classification_context_t {
+	const assembly_t* assembly;
+	const gene_annotation_index_t* gene_annotation_index;
+	const tid_to_contig_t* tid_to_contig;
+	const vector<bool>* interesting_tids;
+	const vector<bool>* viral_contigs_bool;
+	coverage_t* coverage; // NULL, if the coverage is computed in a separate pass
+	const unordered_set<string>* stored_read_through_names; // set in the separate pass, which only computes the coverage
+	bool separate_chimeric_bam_file;
+	bool is_rna_bam_file;
+	bool external_duplicate_marking;
+	unsigned int max_itd_length;
+};
+
+// when reading shards, a read stored as read-through alignment by its shard might have been stored by a preceding shard already,
+// in which case it is not a read-through alignment => this is decided when the shards are merged
+// if the read is a split read, the boundaries of the fragment are only added to the coverage, if it is not a read-through alignment
+typedef unordered_map<string,fragment_boundaries_t> shard_read_throughs_t;
+
+// a first mate whose partner is read by another shard
+struct cross_shard_mate_t {
+	bam_position_t position; // position as given in the BAM file (before conversion of the tid to our contig IDs)
+	string collation_key;
+	bam1_t* bam_record;
+};
+
+// state of collation and classification of a stream of BAM records
+// when the file is read in shards, every thread has its own stream
+struct record_stream_t {
+	record_stream_t(const unsigned int threads, chimeric_alignments_t* chimeric_alignments, const unsigned int contig_count):
+		threads(threads),
+		fragments(FRAGMENTS_PER_THREAD * threads),
+		fragment_count(0),
+		bam_record_pool(2 * FRAGMENTS_PER_THREAD * threads), // the records of a full batch of fragments are returned to the pool at once
+		chimeric_alignments(chimeric_alignments),
+		read_through_names(NULL),
+		shard_read_throughs(NULL),
+		mapped_reads(0),
+		mapped_viral_reads_by_contig(contig_count),
+		no_chimeric_reads(true),
+		missing_hi_tag(0),
+		malformed_count(0),
+		coordinate_sorted(false),
+		sharded(false) {};
+	unsigned int threads; // number of threads used to classify fragments
+	collated_bam_records_t collated_bam_records; // holds the first mate until we have found the second
+	fragments_t fragments;
+	unsigned int fragment_count;
+	bam_record_pool_t bam_record_pool;
+	// results
+	chimeric_alignments_t* chimeric_alignments;
+	unordered_set<string>* read_through_names; // names of stored read-through alignments (only collected, if the coverage is computed in a separate pass)
+	shard_read_throughs_t* shard_read_throughs; // when reading shards, the read-through alignments are needed to merge the shards
+	unsigned long int mapped_reads;
+	vector<unsigned long int> mapped_viral_reads_by_contig;
+	bool no_chimeric_reads;
+	unsigned int missing_hi_tag;
+	unsigned int malformed_count;
+	// in coordinate-sorted input, memory consumption is bounded by freeing mates whose partner should have been seen already and
+	// by moving mates to disk whose partner is far away
+	bool coordinate_sorted;
+	pending_mates_t pending_mates;
+	spilled_mates_t spilled_mates;
+	bam_record_spill_file_t spill_file;
+	// when reading shards, mates whose partner is on another contig are paired after all shards have been read
+	bool sharded;
+	vector<cross_shard_mate_t> cross_shard_mates;
+};
+
+// extract chimeric alignments, internal tandem duplications and read-through alignments from a fragment
+// this function does not modify any shared data, such that it can be run by multiple threads in parallel
+void classify_fragment(fragment_t& fragment, const assembly_t& assembly, const gene_annotation_index_t& gene_annotation_index, const vector<bool>& viral_contigs_bool, const bool separate_chimeric_bam_file, const bool is_rna_bam_file, const unsigned int max_itd_length) {
+
+	bam1_t* bam_record = fragment.mate1;
+	bam1_t* previously_seen_mate = fragment.mate2;
+
+	fragment.chimeric_alignments.clear();
+	fragment.chimeric_alignments.single_end = false;
+	fragment.chimeric_alignments.duplicate = false;
+	fragment.tandem_alignments.clear();
+	fragment.tandem_alignments.single_end = false;
+	fragment.tandem_alignments.duplicate = false;
+	fragment.is_chimeric = false;
+	fragment.is_read_through_candidate = false;
+	fragment.is_split_read = false;
+	fragment.is_malformed = false;
+	fragment.is_pristine_viral_mate1 = false;
+	fragment.is_pristine_viral_mate2 = false;
+	fragment.adds_to_coverage = false;
+
+	switch (fragment.type) {
+
+		case FRAGMENT_SUPPLEMENTARY_FROM_CHIMERIC_FILE:
+			add_chimeric_alignment(fragment.chimeric_alignments, bam_record, true/*supplementary*/);
+			fragment.is_chimeric = true;
+			break;
+
+		case FRAGMENT_SUPPLEMENTARY:
+			if (is_clipped_at_correct_end(bam_record))
+				add_chimeric_alignment(fragment.chimeric_alignments, bam_record, true/*supplementary*/);
+			else
+				fragment.is_malformed = true;
+			fragment.is_chimeric = true;
+			break;
+
+		case FRAGMENT_DISCORDANT_MATE:
+			if (!separate_chimeric_bam_file) { // don't load alignments twice (from Chimeric.out.sam and from Aligned.out.bam)
+				add_chimeric_alignment(fragment.chimeric_alignments, bam_record);
+				fragment.is_chimeric = true;
+			}
+			break;
+
+		case FRAGMENT_MATES:
+
+			if (separate_chimeric_bam_file && !is_rna_bam_file) { // this is Chimeric.out.sam => load everything
+
+				add_chimeric_alignment(fragment.chimeric_alignments, bam_record);
+				if (previously_seen_mate != NULL)
+					add_chimeric_alignment(fragment.chimeric_alignments, previously_seen_mate);
+				fragment.is_chimeric = true;
+
+			} else { // this is Aligned.out.bam => load only discordant mates and split reads, and only when there is no Chimeric.out.sam
+
+				fragment.adds_to_coverage = true;
+
+				// the vast majority of records are neither clipped split reads nor tandem duplications, but only contribute to coverage
+				// => check the CIGAR strings before doing anything expensive (like looking up aux tags)
+				bool is_mate1_clipped = is_clipped(bam_record);
+				bool is_mate2_clipped = is_clipped(previously_seen_mate);
+
+				// STAR is bad at aligning internal tandem duplications (ITD)
+				// it often does not align them at all or maps the clipped segment to a different chromosome with poor alignment quality
+				// => for every clipped alignment, check if it can be aligned as an ITD
+				bool is_tandem_alignment = false;
+				alignment_t tandem_alignment;
+				if ((is_mate1_clipped || is_mate2_clipped) &&
+				    !clipped_sequence_is_adapter(bam_record, previously_seen_mate) &&
+			           (previously_seen_mate == NULL || get_strand(bam_record) != get_strand(previously_seen_mate)) && // strands must be different, so we can distinguish mate1 from mate2
+			           (is_tandem_duplication(bam_record, assembly, max_itd_length, tandem_alignment) || // is it a tandem duplication that STAR failed to align?
+			            is_tandem_duplication(previously_seen_mate, assembly, max_itd_length, tandem_alignment))) {
+					if (is_rna_bam_file) {
+						// imitate a multimapping alignment by adding another alignment for the ITD
+						add_chimeric_alignment(fragment.tandem_alignments, bam_record, get_strand(bam_record) == tandem_alignment.strand && !tandem_alignment.supplementary);
+						if (previously_seen_mate != NULL)
+							add_chimeric_alignment(fragment.tandem_alignments, previously_seen_mate, get_strand(previously_seen_mate) == tandem_alignment.strand && !tandem_alignment.supplementary);
+						fragment.tandem_alignments.push_back(tandem_alignment);
+					}
+					is_tandem_alignment = true;
+				}
+
+				// we extract two types of alignments here: chimeric alignments (having an SA tag) and read-through alignments (crossing gene boundaries)
+				if (is_mate1_clipped && is_clipped_at_correct_end(bam_record) && bam_aux_get(bam_record, "SA") != NULL || // split-read with SA tag
+				    is_mate2_clipped && is_clipped_at_correct_end(previously_seen_mate) && bam_aux_get(previously_seen_mate, "SA") != NULL) { // split-read with SA tag
+					if (!separate_chimeric_bam_file) {
+						add_chimeric_alignment(fragment.chimeric_alignments, bam_record);
+						if (previously_seen_mate != NULL)
+							add_chimeric_alignment(fragment.chimeric_alignments, previously_seen_mate);
+						fragment.is_chimeric = true;
+					}
+				} else if (!is_tandem_alignment) { // could be a read-through alignment
+					fragment.is_read_through_candidate = extract_read_through_alignment(fragment.chimeric_alignments, fragment.is_split_read, bam_record, previously_seen_mate, gene_annotation_index);
+
+					// count mapped reads on viral contigs to detect viral infection
+					// only count perfectly matching alignments to ignore alignment artifacts
+					if (viral_contigs_bool[bam_record->core.tid]) {
+						fragment.is_pristine_viral_mate1 = is_pristine_alignment(bam_record);
+						fragment.is_pristine_viral_mate2 = previously_seen_mate != NULL && is_pristine_alignment(previously_seen_mate);
+					}
+				}
+			}
+
+			// the name is only composed (which requires reading the HI tag), if there is something to store
+			if (!fragment.chimeric_alignments.empty() || !fragment.tandem_alignments.empty()) {
+				char read_name[MAX_READ_NAME_LENGTH];
+				unsigned int read_name_length = make_read_name(bam_record, (separate_chimeric_bam_file) ? 1 : get_hit_index(bam_record), read_name); // ignore HI tag in Chimeric.out.sam, because it only contains unique hits anyway
+				fragment.read_name.assign(read_name, read_name_length);
+			}
+			break;
+	}
+}
+
+// add a classified fragment to the coverage
+// the coverage can be written to by multiple threads concurrently
+void add_fragment_to_coverage(fragment_t& fragment, const classification_context_t& context, const bool is_read_through_alignment, fragment_boundaries_t* deferred_boundaries = NULL) {
+	if (fragment.type == FRAGMENT_DISCORDANT_MATE) {
+		// compute coverage of discordant mates individually as if they were single-end reads
+		if (!context.external_duplicate_marking || !(fragment.mate1->core.flag & BAM_FDUP)) {
+			fragment.mate1->core.flag &= !BAM_FPAIRED;
+			context.coverage->add_fragment(fragment.mate1, NULL, true);
+		}
+	} else if (fragment.adds_to_coverage) {
+		if (!context.external_duplicate_marking || !(fragment.mate1->core.flag & BAM_FDUP))
+			context.coverage->add_fragment(fragment.mate1, fragment.mate2, is_read_through_alignment, deferred_boundaries);
+	}
+}
+
+void classify_fragments(fragment_t* first_fragment, fragment_t* last_fragment, const classification_context_t* context) {
+	for (fragment_t* fragment = first_fragment; fragment != last_fragment; ++fragment) {
+		classify_fragment(*fragment, *context->assembly, *context->gene_annotation_index, *context->viral_contigs_bool, context->separate_chimeric_bam_file, context->is_rna_bam_file, context->max_itd_length);
+
+		// the worker threads compute the coverage, too, such that it does not slow down the sequential merging of fragments
+		// only when a split read is a read-through candidate, whether it counts as chimeric depends on whether it can be stored,
+		// which is not known until the fragment is merged (unless the alignments have been stored in a previous pass)
+		fragment->is_coverage_deferred = false;
+		if (context->coverage != NULL) {
+			if (!fragment->is_read_through_candidate || !fragment->is_split_read)
+				add_fragment_to_coverage(*fragment, *context, fragment->is_read_through_candidate);
+			else if (context->stored_read_through_names != NULL)
+				add_fragment_to_coverage(*fragment, *context, context->stored_read_through_names->find(fragment->read_name) != context->stored_read_through_names->end());
+			else
+				fragment->is_coverage_deferred = true;
+		}
+	}
+}
+
+// append the alignments of <source> to <target> as if they had been added via add_chimeric_alignment()
+void append_chimeric_alignments(mates_t& target, const mates_t& source) {
+	target.single_end = source.single_end;
+	target.duplicate = target.duplicate || source.duplicate;
+	target.insert(target.end(), source.begin(), source.end());
+}
+
+// merge the results of classification into the chimeric alignments
+// this must be done sequentially in the order in which the BAM records appear in the input file
+void merge_fragment(fragment_t& fragment, record_stream_t& stream, const classification_context_t& context) {
+
+	bool is_read_through_alignment = false;
+	if (context.stored_read_through_names == NULL) { // unless the alignments have been stored in a previous pass already and only the coverage is computed
+
+		chimeric_alignments_t& chimeric_alignments = *stream.chimeric_alignments;
+
+		if (!fragment.tandem_alignments.empty())
+			append_chimeric_alignments(chimeric_alignments[fragment.read_name + "ITD"], fragment.tandem_alignments);
+
+		if (fragment.is_read_through_candidate) {
+			// store read-through alignments, unless they are already stored as chimeric alignments
+			pair<chimeric_alignments_t::iterator,bool> mates = chimeric_alignments.insert(fragment.read_name, mates_t());
+			if (mates.second) { // insertion succeeded => the alignments have not been stored previously
+				mates.first->second = fragment.chimeric_alignments;
+				if (stream.shard_read_throughs != NULL) {
+					// whether a preceding shard has stored the read already is only known when the shards are merged
+					fragment_boundaries_t& deferred_boundaries = (*stream.shard_read_throughs)[fragment.read_name];
+					if (fragment.is_coverage_deferred) {
+						add_fragment_to_coverage(fragment, context, true, &deferred_boundaries);
+						fragment.is_coverage_deferred = false;
+					}
+				} else if (stream.read_through_names != NULL) {
+					stream.read_through_names->insert(fragment.read_name);
+				}
+			}
+			is_read_through_alignment = mates.second || !fragment.is_split_read;
+		} else if (!fragment.chimeric_alignments.empty()) {
+			append_chimeric_alignments(chimeric_alignments[fragment.read_name], fragment.chimeric_alignments);
+		}
+	}
+
+	if (fragment.is_chimeric)
+		stream.no_chimeric_reads = false;
+	if (fragment.is_malformed)
+		stream.malformed_count++;
+	if (fragment.is_pristine_viral_mate1)
+		stream.mapped_viral_reads_by_contig[fragment.mate1->core.tid]++;
+	if (fragment.is_pristine_viral_mate2)
+		stream.mapped_viral_reads_by_contig[fragment.mate2->core.tid]++;
+
+	if (fragment.is_coverage_deferred)
+		add_fragment_to_coverage(fragment, context, is_read_through_alignment);
+}
+
+// hand over a BAM record to the next free fragment and take a record for the next read from the pool
+void enqueue_fragment(record_stream_t& stream, const fragment_type_t type, const char* read_name, const unsigned int read_name_length, bam1_t*& bam_record, bam1_t* previously_seen_mate) {
+	fragment_t& fragment = stream.fragments[stream.fragment_count++];
+	fragment.type = type;
+	if (read_name != NULL)
+		fragment.read_name.assign(read_name, read_name_length); // reuses the memory of the fragment, which was processed previously in this slot
+	else
+		fragment.read_name.clear(); // the name is composed during classification
+	fragment.mate1 = bam_record;
+	fragment.mate2 = previously_seen_mate;
+	bam_record = stream.bam_record_pool.acquire();
+}
+
+// classify a batch of fragments using multiple threads and merge the results into the chimeric alignments
+void process_fragments(record_stream_t& stream, const classification_context_t& context) {
+
+	const unsigned int fragment_count = stream.fragment_count;
+	if (fragment_count == 0)
+		return;
+	fragments_t& fragments = stream.fragments;
+
+	// each thread classifies a contiguous chunk of fragments, the calling thread takes the first chunk
+	unsigned int chunk_size = (fragment_count + stream.threads - 1) / stream.threads;
+	vector<thread> workers;
+	for (unsigned int chunk_start = chunk_size; chunk_start < fragment_count; chunk_start += chunk_size)
+		workers.push_back(thread(classify_fragments, &fragments[chunk_start], &fragments[0] + min(chunk_start + chunk_size, fragment_count), &context));
+	classify_fragments(&fragments[0], &fragments[0] + min(chunk_size, fragment_count), &context);
+	for (vector<thread>::iterator worker = workers.begin(); worker != workers.end(); ++worker)
+		worker->join();
+
+	// merge the results in the order of the BAM records, so that the result does not depend on the number of threads
+	for (unsigned int i = 0; i < fragment_count; ++i) {
+		merge_fragment(fragments[i], stream, context);
+		stream.bam_record_pool.release(fragments[i].mate1);
+		if (fragments[i].mate2 != NULL)
+			stream.bam_record_pool.release(fragments[i].mate2);
+	}
+	stream.fragment_count = 0;
+}
+
+// in coordinate-sorted input, the mate of a first mate must be found at the position given by mtid/mpos
+// => load mates from disk whose partner is about to be read and
+//    free mates whose partner should have been read already (i.e., the partner was not loaded, e.g., because it is a secondary alignment that lacks the HI tag)
+void advance_sorted_collation(const bam_position_t& current_position, record_stream_t& stream, const bool separate_chimeric_bam_file) {
+
+	while (!stream.spilled_mates.empty() && stream.spilled_mates.begin()->first <= current_position) {
+		bam1_t* bam_record = stream.bam_record_pool.acquire();
+		string collation_key;
+		stream.spill_file.read(stream.spilled_mates.begin()->second.first, collation_key, bam_record);
+		stream.spill_file.release();
+		collated_mate_t collated_mate = { bam_record, stream.pending_mates.end() };
+		pair<collated_bam_records_t::iterator,bool> inserted_mate = stream.collated_bam_records.insert_ks(collation_key.c_str(), collation_key.size(), collated_mate);
+		if (inserted_mate.second)
+			inserted_mate.first->pending_mate = stream.pending_mates.insert(make_pair(stream.spilled_mates.begin()->first, make_pair(bam_record, stream.spilled_mates.begin()->second.second)));
+		else // a record with the same name is already waiting for its mate
+			stream.bam_record_pool.release(bam_record);
+		stream.spilled_mates.erase(stream.spilled_mates.begin());
+	}
+
+	char collation_key[MAX_COLLATION_KEY_LENGTH];
+	while (!stream.pending_mates.empty() && stream.pending_mates.begin()->first < current_position) {
+		bam1_t* pending_mate = stream.pending_mates.begin()->second.first;
+		unsigned int collation_key_length = make_collation_key(pending_mate, stream.pending_mates.begin()->second.second, separate_chimeric_bam_file, collation_key);
+		collated_bam_records_t::iterator orphaned_mate = stream.collated_bam_records.find_ks(collation_key, collation_key_length);
+		if (orphaned_mate != stream.collated_bam_records.end() && orphaned_mate->bam_record == pending_mate) { // paired records have no pending entry, so this always holds
+			stream.bam_record_pool.release(pending_mate);
+			stream.collated_bam_records.erase(orphaned_mate);
+		}
+		stream.pending_mates.erase(stream.pending_mates.begin());
+	}
+}
+
+// classify the remaining fragments and free all mates which are still waiting for their partner
+void finish_stream(record_stream_t& stream, const classification_context_t& context) {
+	process_fragments(stream, context);
+	for (collated_bam_records_t::iterator unpaired_mate = stream.collated_bam_records.begin(); unpaired_mate != stream.collated_bam_records.end(); ++unpaired_mate)
+		stream.bam_record_pool.release(unpaired_mate->bam_record);
+	stream.collated_bam_records.clear();
+	stream.pending_mates.clear();
+	for (; !stream.spilled_mates.empty(); stream.spilled_mates.erase(stream.spilled_mates.begin()))
+		stream.spill_file.release();
+}
+
+unsigned int load_regions(const string& regions_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, regions_t& regions) {
+	autodecompress_file_t regions_file(regions_file_path);
+	string line;
+	while (regions_file.getline(line)) {
+		if (line.empty() || line[0] == '#' || line.substr(0, 6) == "track " || line.substr(0, 8) == "browser ")
+			continue;
+
+		// try to parse line as BED (contig, zero-based start, end)
+		tsv_stream_t tsv(line);
+		string contig_name, start, end;
+		tsv >> contig_name >> start >> end;
+		region_t region;
+		int bed_start, bed_end;
+		if (!end.empty() && str_to_int(start.c_str(), bed_start) && str_to_int(end.c_str(), bed_end)) {
+			contigs_t::const_iterator contig = contigs.find(removeChr(contig_name));
+			if (contig == contigs.end()) {
+				cerr << "WARNING: unknown contig: " << contig_name << endl;
+				continue;
+			}
+			region.contig = contig->second;
+			region.start = bed_start;
+			region.end = bed_end - 1;
+			regions.push_back(region);
+
+		} else { // every column is a gene or a range (e.g., a list of known fusions)
+			tsv_stream_t tsv2(line);
+			string column;
+			while (!(tsv2 >> column).fail()) {
+				blacklist_item_t item;
+				if (parse_blacklist_item(column, item, contigs, genes, false)) {
+					region.contig = item.contig;
+					region.start = item.start;
+					region.end = item.end;
+					regions.push_back(region);
+				}
+			}
+		}
+	}
+	return regions.size();
+}
+
+// sort regions and merge overlapping ones
+void merge_bam_regions(bam_regions_t& bam_regions) {
+	for (bam_regions_t::iterator contig = bam_regions.begin(); contig != bam_regions.end(); ++contig) {
+		if (contig->empty())
+			continue;
+		sort(contig->begin(), contig->end());
+		vector< pair<hts_pos_t,hts_pos_t> >::iterator merged = contig->begin();
+		for (vector< pair<hts_pos_t,hts_pos_t> >::iterator region = next(contig->begin()); region != contig->end(); ++region) {
+			if (region->first <= merged->second) {
+				merged->second = max(merged->second, region->second);
+			} else {
+				++merged;
+				*merged = *region;
+			}
+		}
+		contig->resize(merged - contig->begin() + 1);
+	}
+}
+
+// check if the interval [start, end) overlaps any of the regions
+bool overlaps_bam_regions(const bam_regions_t& bam_regions, const int32_t tid, const hts_pos_t start, const hts_pos_t end) {
+	if (tid < 0 || (unsigned int) tid >= bam_regions.size() || bam_regions[tid].empty())
+		return false;
+	// binary search for the first region which ends after <start>
+	const vector< pair<hts_pos_t,hts_pos_t> >& contig = bam_regions[tid];
+	size_t low = 0, high = contig.size();
+	while (low < high) {
+		size_t middle = (low + high) / 2;
+		if (contig[middle].second <= start)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low < contig.size() && contig[low].first < end;
+}
+
+// make an iterator over all given regions, each record is returned only once
+hts_itr_t* make_region_iterator(hts_idx_t* bam_index, bam_hdr_t* bam_header, const bam_regions_t& bam_regions) {
+	vector<string> region_strings;
+	for (unsigned int tid = 0; tid < bam_regions.size(); ++tid) {
+		string contig_name = bam_header->target_name[tid];
+		if (contig_name.find(':') != string::npos)
+			contig_name = "{" + contig_name + "}"; // protect colons in contig name from being interpreted as range
+		for (vector< pair<hts_pos_t,hts_pos_t> >::const_iterator region = bam_regions[tid].begin(); region != bam_regions[tid].end(); ++region)
+			region_strings.push_back(contig_name + ":" + to_string(static_cast<long long int>(region->first + 1)) + "-" + to_string(static_cast<long long int>(region->second)));
+	}
+	if (region_strings.empty())
+		return NULL;
+	vector<char*> region_array(region_strings.size());
+	for (unsigned int i = 0; i < region_strings.size(); ++i)
+		region_array[i] = &region_strings[i][0];
+	hts_itr_t* iterator = sam_itr_regarray(bam_index, bam_header, &region_array[0], region_array.size());
+	crash(iterator == NULL, "failed to create iterator over regions");
+	return iterator;
+}
+
+// remember the positions of the mate and of supplementary alignments of a record in the regions,
+// if they are not inside the regions themselves, such that they can be loaded in a second pass
+void collect_mate_regions(const bam1_t* bam_record, bam_hdr_t* bam_header, const bam_regions_t& bam_regions, bam_regions_t& mate_regions, unordered_set<string>& wanted_mates) {
+
+	if ((bam_record->core.flag & BAM_FPAIRED) && !(bam_record->core.flag & BAM_FMUNMAP) && bam_record->core.mtid >= 0 &&
+	    !overlaps_bam_regions(bam_regions, bam_record->core.mtid, bam_record->core.mpos, bam_record->core.mpos + 1)) {
+		mate_regions[bam_record->core.mtid].push_back(make_pair(bam_record->core.mpos, bam_record->core.mpos + 1));
+		wanted_mates.insert(bam_get_qname(bam_record));
+	}
+
+	// SA tag has the format: contig,position,strand,CIGAR,MAPQ,NM;...
+	uint8_t* sa_tag = bam_aux_get(bam_record, "SA");
+	if (sa_tag != NULL) {
+		string supplementary_alignments = bam_aux2Z(sa_tag);
+		replace(supplementary_alignments.begin(), supplementary_alignments.end(), ';', '\t');
+		tsv_stream_t tsv(supplementary_alignments);
+		string supplementary_alignment;
+		while (!(tsv >> supplementary_alignment).fail()) {
+			tsv_stream_t tsv2(supplementary_alignment, ',');
+			string contig_name;
+			int position;
+			if ((tsv2 >> contig_name >> position).fail())
+				continue;
+			int32_t tid = sam_hdr_name2tid(bam_header, contig_name.c_str());
+			if (tid >= 0 && !overlaps_bam_regions(bam_regions, tid, position - 1, position)) {
+				mate_regions[tid].push_back(make_pair(position - 1, position));
+				wanted_mates.insert(bam_get_qname(bam_record));
+			}
+		}
+	}
+}
+
+bool compare_cross_shard_mates_by_position(const cross_shard_mate_t& x, const cross_shard_mate_t& y) {
+	return x.position < y.position;
+}
+
+// read BAM records, collate mates and hand them over to the worker threads in batches of fragments
+// reading is done by a dedicated thread, such that the upstream program is not blocked by the processing of the records
+void read_records(record_stream_t& stream, const classification_context_t& context, samFile* bam_file, bam_hdr_t* bam_header, hts_itr_t* iterator, const unsigned int pass, const bam_regions_t* bam_regions, bam_regions_t* mate_regions, unordered_set<string>* wanted_mates) {
+
+	const bool separate_chimeric_bam_file = context.separate_chimeric_bam_file;
+	const bool is_rna_bam_file = context.is_rna_bam_file;
+	char read_name[MAX_READ_NAME_LENGTH];
+	unsigned int read_name_length;
+	char collation_key[MAX_COLLATION_KEY_LENGTH];
+	unsigned int collation_key_length;
+	int sam_read1_status = -1;
+
+	bam_record_reader_t bam_record_reader(bam_file, bam_header, iterator);
+	bool last_batch = false;
+	while (!last_batch) {
+		bam_record_batch_t* batch = bam_record_reader.next_batch();
+		for (unsigned int i = 0; i < batch->size; ++i) {
+			bam1_t*& bam_record = batch->records[i];
+
+			// classify the batch of fragments, once it is full
+			if (stream.fragment_count == stream.fragments.size())
+				process_fragments(stream, context);
+
+			if (is_rna_bam_file)
+				if ((bam_record->core.flag & BAM_FUNMAP) || (bam_record->core.flag & BAM_FPAIRED) && (bam_record->core.flag & BAM_FMUNMAP))
+					continue; // ignore unmapped reads
+
+			if (bam_regions != NULL) {
+				if (pass == 0) // remember where to find the mates of records in the regions
+					collect_mate_regions(bam_record, bam_header, *bam_regions, *mate_regions, *wanted_mates);
+				else if (wanted_mates->find(bam_get_qname(bam_record)) == wanted_mates->end() || overlaps_bam_regions(*bam_regions, bam_record->core.tid, bam_record->core.pos, bam_endpos(bam_record)))
+					continue; // ignore records which are not mates of records in the regions or which have been read in the first pass already
+			}
+
+			bam_position_t current_position(bam_record->core.tid, bam_record->core.pos);
+			if (stream.coordinate_sorted && current_position.first >= 0)
+				advance_sorted_collation(current_position, stream, separate_chimeric_bam_file);
+
+			// ignore secondary alignments when HI tag is missing, because multi-mapping alignments could not be segregated
+			// the HI tag of primary alignments is only read, when they are stored
+			if (!separate_chimeric_bam_file && (bam_record->core.flag & BAM_FSECONDARY) && bam_aux_get(bam_record, "HI") == NULL) { // ignore HI tag in Chimeric.out.sam, because it only contains unique hits anyway
+				stream.missing_hi_tag++;
+				continue;
+			}
+
+			// fix contig number to match ours
+			bam_record->core.tid = (*context.tid_to_contig)[bam_record->core.tid];
+
+			// add supplementary alignments directly to the chimeric alignments without collating
+			if (separate_chimeric_bam_file && !is_rna_bam_file && (bam_record->core.flag & BAM_FSECONDARY)) { // extract supplementary reads from Chimeric.out.sam
+				read_name_length = make_read_name(bam_record, 1, read_name);
+				enqueue_fragment(stream, FRAGMENT_SUPPLEMENTARY_FROM_CHIMERIC_FILE, read_name, read_name_length, bam_record, NULL);
+				continue;
+			}
+
+			// add supplementary alignments directly to the chimeric alignments without collating
+			if (is_rna_bam_file && (bam_record->core.flag & BAM_FSUPPLEMENTARY)) { // extract supplementary reads from Aligned.out.bam
+				if (!separate_chimeric_bam_file) { // don't load alignments twice (from Chimeric.out.sam and from Aligned.out.bam)
+					read_name_length = make_read_name(bam_record, get_hit_index(bam_record), read_name);
+					enqueue_fragment(stream, FRAGMENT_SUPPLEMENTARY, read_name, read_name_length, bam_record, NULL);
+				}
+				continue;
+			}
+
+			// count mapped reads on interesting contigs
+			if ((*context.interesting_tids)[bam_record->core.tid])
+				stream.mapped_reads++;
+
+			// add discordant mates directly to the chimeric alignments without collating
+			if (is_rna_bam_file && (bam_record->core.flag & BAM_FPAIRED) && !(bam_record->core.flag & BAM_FPROPER_PAIR)) { // extract discordant mates from Aligned.out.bam
+				read_name_length = make_read_name(bam_record, (separate_chimeric_bam_file) ? 1 : get_hit_index(bam_record), read_name);
+				enqueue_fragment(stream, FRAGMENT_DISCORDANT_MATE, read_name, read_name_length, bam_record, NULL);
+				continue;
+			}
+
+			// for paired-end data we need to wait until we have read both mates
+			bam1_t* previously_seen_mate = NULL;
+			if (bam_record->core.flag & BAM_FPAIRED) {
+
+				// try to insert the mate into the collated BAM records
+				// if there was already a record with the same collation key, insertion will fail (->second set to false) and
+				// previously_seen_mate->first will point to the mate which was already in the collated BAM records
+				collation_key_length = make_collation_key(bam_record, current_position.first, separate_chimeric_bam_file, collation_key);
+				collated_mate_t collated_mate = { bam_record, stream.pending_mates.end() };
+				pair<collated_bam_records_t::iterator,bool> find_previously_seen_mate = stream.collated_bam_records.insert_ks(collation_key, collation_key_length, collated_mate);
+				if (!find_previously_seen_mate.second) { // this is the second mate we have seen
+					previously_seen_mate = find_previously_seen_mate.first->bam_record;
+					if (find_previously_seen_mate.first->pending_mate != stream.pending_mates.end())
+						stream.pending_mates.erase(find_previously_seen_mate.first->pending_mate); // the record must not be touched anymore, once it is returned to the pool
+					stream.collated_bam_records.erase(find_previously_seen_mate.first);
+
+				} else if (stream.coordinate_sorted) { // this is the first mate => check where to find the second
+					bam_position_t mate_position(bam_record->core.mtid, bam_record->core.mpos);
+					if (stream.sharded && mate_position.first >= 0 && mate_position.first != current_position.first) { // the mate is read by another shard => pair it after all shards have been read
+						stream.collated_bam_records.erase(find_previously_seen_mate.first);
+						cross_shard_mate_t cross_shard_mate = { current_position, string(collation_key, collation_key_length), bam_record };
+						stream.cross_shard_mates.push_back(cross_shard_mate);
+						bam_record = stream.bam_record_pool.acquire();
+						continue;
+					} else if (mate_position < current_position) { // the mate has been passed already without being loaded => it will never be found
+						stream.collated_bam_records.erase(find_previously_seen_mate.first);
+						continue;
+					} else if (mate_position.first != current_position.first || mate_position.second - current_position.second > MAX_IN_MEMORY_MATE_DISTANCE) { // the mate is far away => move to disk
+						stream.collated_bam_records.erase(find_previously_seen_mate.first);
+						stream.spilled_mates.insert(make_pair(mate_position, make_pair(stream.spill_file.write(collation_key, collation_key_length, bam_record), current_position.first)));
+						continue;
+					} else {
+						find_previously_seen_mate.first->pending_mate = stream.pending_mates.insert(make_pair(mate_position, make_pair(bam_record, current_position.first)));
+					}
+				}
+
+			}
+
+			if ((bam_record->core.flag & BAM_FPAIRED) && previously_seen_mate == NULL) { // this is the first mate with the given read name, which we encounter
+
+				stream.bam_record_pool.update_pending_records(stream.collated_bam_records.size());
+				bam_record = stream.bam_record_pool.acquire(); // take a record for the next read from the pool
+
+			} else { // single-end data or we have already read the first mate previously
+				enqueue_fragment(stream, FRAGMENT_MATES, NULL, 0, bam_record, previously_seen_mate); // the name is only composed, if the fragment is stored
+			}
+		}
+		last_batch = batch->last;
+		sam_read1_status = batch->sam_read1_status;
+		if (!last_batch)
+			bam_record_reader.recycle_batch(batch);
+	}
+	crash(sam_read1_status < -1, "failed to load alignments");
+}
+
+// read the records overlapping the regions using the index of the BAM file
+// the mates and supplementary alignments of these records are read in a second pass
+void read_records_in_regions(record_stream_t& stream, const classification_context_t& context, samFile* bam_file, bam_hdr_t* bam_header, hts_idx_t* bam_index, const bam_regions_t& bam_regions) {
+	bam_regions_t mate_regions(bam_header->n_targets);
+	unordered_set<string> wanted_mates;
+	for (unsigned int pass = 0; pass < 2; ++pass) {
+		if (pass == 1)
+			merge_bam_regions(mate_regions);
+		hts_itr_t* iterator = make_region_iterator(bam_index, bam_header, (pass == 0) ? bam_regions : mate_regions);
+		if (iterator == NULL)
+			continue; // nothing to read
+		read_records(stream, context, bam_file, bam_header, iterator, pass, &bam_regions, &mate_regions, &wanted_mates);
+		hts_itr_destroy(iterator);
+	}
+}
+
+// a shard comprises all records of one contig, which are read by one of several threads
+// the records of a contig are classified using the stream of the thread, but the results are stored separately for each contig,
+// such that they can be merged in a deterministic order
+void read_shards(record_stream_t* stream, const classification_context_t* context, const string* bam_file_path, const string* assembly_file_path, const hts_idx_t* bam_index, const vector<int32_t>* tids, atomic<unsigned int>* next_tid, vector<chimeric_alignments_t>* chimeric_alignments_by_tid, vector<shard_read_throughs_t>* read_throughs_by_tid) {
+
+	// every thread has its own file handle, such that the shards can be read independently
+	samFile* bam_file = sam_open(bam_file_path->c_str(), "rb");
+	crash(bam_file == NULL, "failed to open SAM file");
+	if (bam_file->is_cram)
+		cram_set_option(bam_file->fp.cram, CRAM_OPT_REFERENCE, assembly_file_path->c_str());
+	bam_hdr_t* bam_header = sam_hdr_read(bam_file);
+	crash(bam_header == NULL, "failed to read SAM header");
+
+	for (unsigned int i = (*next_tid)++; i < tids->size(); i = (*next_tid)++) {
+		int32_t tid = (*tids)[i];
+		hts_itr_t* iterator = sam_itr_queryi(bam_index, tid, 0, HTS_POS_MAX);
+		crash(iterator == NULL, "failed to query index");
+		stream->chimeric_alignments = &(*chimeric_alignments_by_tid)[tid];
+		stream->shard_read_throughs = &(*read_throughs_by_tid)[tid];
+		read_records(*stream, *context, bam_file, bam_header, iterator, 0, NULL, NULL, NULL);
+		finish_stream(*stream, *context); // all mates of this contig have been seen
+		hts_itr_destroy(iterator);
+	}
+
+	bam_hdr_destroy(bam_header);
+	sam_close(bam_file);
+}
+
+unsigned int read_chimeric_alignments(const string& bam_file_path, const assembly_t& assembly, const string& assembly_file_path, chimeric_alignments_t& chimeric_alignments, unsigned long int& mapped_reads, vector<unsigned long int>& mapped_viral_reads_by_contig, coverage_t& coverage, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const string& viral_contigs, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file, const bool is_rna_bam_file, const bool external_duplicate_marking, const unsigned int max_itd_length, const unsigned int threads, const regions_t& regions, const bool sharded, unordered_set<string>* read_through_names) {
 
 	// open BAM file
 	samFile* bam_file = sam_open(bam_file_path.c_str(), "rb");
 	crash(bam_file == NULL, "failed to open SAM file");
 	if (bam_file->is_cram)
 		cram_set_option(bam_file->fp.cram, CRAM_OPT_REFERENCE, assembly_file_path.c_str());
+	if (threads > 1 && !sharded) // decompress BGZF/CRAM blocks in parallel (when reading shards, the threads are used to read the contigs instead)
+		crash(hts_set_threads(bam_file, threads) != 0, "failed to create thread pool");
 	bam_hdr_t* bam_header = sam_hdr_read(bam_file);
 	crash(bam_header == NULL, "failed to read SAM header");
 
+	// when the coverage is computed in a separate pass, the file is read via the index in that pass
+	// => check that it can be done before reading the whole file rather than after
+	if (read_through_names != NULL) {
+		crash(!is_coordinate_sorted(bam_header), "computing the coverage near chimeric alignments requires a coordinate-sorted file");
+		hts_idx_t* bam_index = sam_index_load(bam_file, bam_file_path.c_str());
+		crash(bam_index == NULL, "failed to load index of '" + bam_file_path + "' (computing the coverage near chimeric alignments requires a coordinate-sorted and indexed file)");
+		hts_idx_destroy(bam_index);
+	}
+
 	// add contigs which are not yet listed in <contigs>
 	// and make a map tid -> contig, because the contig IDs in the BAM file need not necessarily match the contig IDs in the GTF file
 	tid_to_contig_t tid_to_contig(bam_header->n_targets);
@@ -586,6 +1441,21 @@ unsigned int read_chimeric_alignments(const string& bam_file_path, const assembl
 	}
 	coverage.resize(contigs, assembly);
 
+	// when regions are given, only records overlapping the regions are read using the index of the BAM file
+	hts_idx_t* bam_index = NULL;
+	bam_regions_t bam_regions(bam_header->n_targets);
+	if (!regions.empty()) {
+		bam_index = sam_index_load(bam_file, bam_file_path.c_str());
+		crash(bam_index == NULL, "failed to load index of '" + bam_file_path + "' (restriction to regions requires a coordinate-sorted and indexed file)");
+		vector<int32_t> contig_to_tid(contigs.size(), -1);
+		for (int target = 0; target < bam_header->n_targets; ++target)
+			contig_to_tid[tid_to_contig[target]] = target;
+		for (regions_t::const_iterator region = regions.begin(); region != regions.end(); ++region)
+			if ((unsigned int) region->contig < contig_to_tid.size() && contig_to_tid[region->contig] >= 0)
+				bam_regions[contig_to_tid[region->contig]].push_back(make_pair(region->start, region->end + 1));
+		merge_bam_regions(bam_regions);
+	}
+
 	// make sure we have the sequence of all interesting contigs, otherwise later steps will crash
 	for (contigs_t::iterator contig = contigs.begin(); contig != contigs.end(); ++contig)
 		crash(assembly.find(contig->second) == assembly.end() && is_interesting_contig(contig->first, interesting_contigs), "could not find sequence of contig '" + contig->first + "'");
@@ -596,159 +1466,131 @@ unsigned int read_chimeric_alignments(const string& bam_file_path, const assembl
 		viral_contigs_bool[contig->second] = is_interesting_contig(contig->first, viral_contigs);
 	mapped_viral_reads_by_contig.resize(contigs.size());
 
-	// read BAM records
-	bam1_t* bam_record = bam_init1();
-	crash(bam_record == NULL, "failed to allocate memory.");
-	collated_bam_records_t collated_bam_records; // holds the first mate until we have found the second
-	bool no_chimeric_reads = true;
-	unsigned int missing_hi_tag = 0;
-	unsigned int malformed_count = 0;
-	string read_name;
-	int sam_read1_status;
-	while ((sam_read1_status = sam_read1(bam_file, bam_header, bam_record)) >= 0) {
-
-		if (is_rna_bam_file)
-			if ((bam_record->core.flag & BAM_FUNMAP) || (bam_record->core.flag & BAM_FPAIRED) && (bam_record->core.flag & BAM_FMUNMAP))
-				continue; // ignore unmapped reads
-
-		int64_t hit_index = 1;
-		if (!separate_chimeric_bam_file) { // ignore HI tag in Chimeric.out.sam, because it only contains unique hits anyway
-			uint8_t* hi_tag = bam_aux_get(bam_record, "HI");
-			if (hi_tag != NULL) {
-				hit_index = bam_aux2i(hi_tag);
-			} else if (bam_record->core.flag & BAM_FSECONDARY) {
-				missing_hi_tag++;
-				continue; // ignore secondary alignments when HI tag is missing, because multi-mapping alignments could not be segregated
-			}
+	// data needed to classify fragments
+	classification_context_t context;
+	context.assembly = &assembly;
+	context.gene_annotation_index = &gene_annotation_index;
+	context.tid_to_contig = &tid_to_contig;
+	context.interesting_tids = &interesting_tids;
+	context.viral_contigs_bool = &viral_contigs_bool;
+	context.coverage = (read_through_names == NULL) ? &coverage : NULL;
+	context.stored_read_through_names = NULL;
+	context.separate_chimeric_bam_file = separate_chimeric_bam_file;
+	context.is_rna_bam_file = is_rna_bam_file;
+	context.external_duplicate_marking = external_duplicate_marking;
+	context.max_itd_length = max_itd_length;
+
+	vector<record_stream_t*> streams;
+	if (!sharded) {
+
+		// read BAM records
+		// the records are collated and handed over to worker threads in batches of fragments
+		record_stream_t* stream = new record_stream_t(threads, &chimeric_alignments, contigs.size());
+		streams.push_back(stream);
+		stream->read_through_names = read_through_names;
+		stream->coordinate_sorted = regions.empty() && is_coordinate_sorted(bam_header); // when reading regions, mates outside the regions are only read in the second pass
+		if (regions.empty())
+			read_records(*stream, context, bam_file, bam_header, NULL, 0, NULL, NULL, NULL);
+		else
+			read_records_in_regions(*stream, context, bam_file, bam_header, bam_index, bam_regions);
+
+		// classify the remaining fragments
+		finish_stream(*stream, context);
+
+	} else {
+
+		// read the contigs in parallel using one stream per thread
+		// the biggest contigs are read first to balance the load between the threads
+		bam_index = sam_index_load(bam_file, bam_file_path.c_str());
+		crash(bam_index == NULL, "failed to load index of '" + bam_file_path + "' (parallel reading requires a coordinate-sorted and indexed file)");
+		crash(!is_coordinate_sorted(bam_header), "parallel reading requires a coordinate-sorted file");
+		vector< pair<uint64_t,int32_t> > mapped_reads_by_tid;
+		for (int target = 0; target < bam_header->n_targets; ++target) {
+			uint64_t mapped = 0, unmapped = 0;
+			hts_idx_get_stat(bam_index, target, &mapped, &unmapped);
+			mapped_reads_by_tid.push_back(make_pair(mapped + unmapped, target));
 		}
-		read_name = (char*) bam_get_qname(bam_record);
-		read_name += "," + to_string(hit_index); // append HI tag to name to enable segregation of multi-mapping reads
-
-		// fix contig number to match ours
-		bam_record->core.tid = tid_to_contig[bam_record->core.tid];
-
-		// add supplementary alignments directly to the chimeric alignments without collating
-		if (separate_chimeric_bam_file && !is_rna_bam_file && (bam_record->core.flag & BAM_FSECONDARY)) { // extract supplementary reads from Chimeric.out.sam
-			add_chimeric_alignment(chimeric_alignments[read_name], bam_record, true/*supplementary*/);
-			no_chimeric_reads = false;
-			continue;
+		sort(mapped_reads_by_tid.rbegin(), mapped_reads_by_tid.rend());
+		vector<int32_t> tids;
+		for (vector< pair<uint64_t,int32_t> >::iterator target = mapped_reads_by_tid.begin(); target != mapped_reads_by_tid.end(); ++target)
+			tids.push_back(target->second);
+
+		vector<chimeric_alignments_t> chimeric_alignments_by_tid(bam_header->n_targets);
+		vector<shard_read_throughs_t> read_throughs_by_tid(bam_header->n_targets);
+		atomic<unsigned int> next_tid(0);
+		vector<thread> workers;
+		for (unsigned int i = 0; i < threads; ++i) {
+			record_stream_t* stream = new record_stream_t(1, NULL, contigs.size());
+			stream->coordinate_sorted = true;
+			stream->sharded = true;
+			streams.push_back(stream);
+			workers.push_back(thread(read_shards, stream, &context, &bam_file_path, &assembly_file_path, bam_index, &tids, &next_tid, &chimeric_alignments_by_tid, &read_throughs_by_tid));
 		}
-
-		// add supplementary alignments directly to the chimeric alignments without collating
-		if (is_rna_bam_file && (bam_record->core.flag & BAM_FSUPPLEMENTARY)) { // extract supplementary reads from Aligned.out.bam
-			if (!separate_chimeric_bam_file) { // don't load alignments twice (from Chimeric.out.sam and from Aligned.out.bam)
-				if (is_clipped_at_correct_end(bam_record))
-					add_chimeric_alignment(chimeric_alignments[read_name], bam_record, true/*supplementary*/);
-				else
-					malformed_count++;
-				no_chimeric_reads = false;
+		for (vector<thread>::iterator worker = workers.begin(); worker != workers.end(); ++worker)
+			worker->join();
+
+		// merge the shards in the order of the contigs in the BAM file
+		for (int target = 0; target < bam_header->n_targets; ++target) {
+			for (chimeric_alignments_t::iterator mates = chimeric_alignments_by_tid[target].begin(); mates != chimeric_alignments_by_tid[target].end(); ++mates) {
+				pair<chimeric_alignments_t::iterator,bool> merged_mates = chimeric_alignments.insert(*mates);
+				shard_read_throughs_t::iterator read_through = read_throughs_by_tid[target].find(mates->first);
+				if (read_through == read_throughs_by_tid[target].end()) {
+					if (!merged_mates.second)
+						append_chimeric_alignments(merged_mates.first->second, mates->second);
+				} else if (merged_mates.second) { // read-through alignments are only stored if the read has not been stored already
+					if (read_through_names != NULL)
+						read_through_names->insert(mates->first);
+				} else if (context.coverage != NULL) { // the read has been stored by a preceding shard => it does not count as read-through alignment
+					context.coverage->add_fragment_boundaries(read_through->second);
+				}
 			}
-			continue;
+			chimeric_alignments_by_tid[target].clear();
+			read_throughs_by_tid[target].clear();
 		}
 
-		// count mapped reads on interesting contigs
-		if (interesting_tids[bam_record->core.tid])
-			mapped_reads++;
-
-		// add discordant mates directly to the chimeric alignments without collating
-		if (is_rna_bam_file && (bam_record->core.flag & BAM_FPAIRED) && !(bam_record->core.flag & BAM_FPROPER_PAIR)) { // extract discordant mates from Aligned.out.bam
-			if (!separate_chimeric_bam_file) { // don't load alignments twice (from Chimeric.out.sam and from Aligned.out.bam)
-				add_chimeric_alignment(chimeric_alignments[read_name], bam_record);
-				no_chimeric_reads = false;
-			}
-			// compute coverage of discordant mates individually as if they were single-end reads
-			if (!external_duplicate_marking || !(bam_record->core.flag & BAM_FDUP)) {
-				bam_record->core.flag &= !BAM_FPAIRED;
-				coverage.add_fragment(bam_record, NULL, true);
-			}
-			continue;
+		// pair the mates whose partner was read by another shard
+		vector<cross_shard_mate_t> cross_shard_mates;
+		for (vector<record_stream_t*>::iterator stream = streams.begin(); stream != streams.end(); ++stream) {
+			cross_shard_mates.insert(cross_shard_mates.end(), (**stream).cross_shard_mates.begin(), (**stream).cross_shard_mates.end());
+			(**stream).cross_shard_mates.clear();
 		}
-
-		// for paired-end data we need to wait until we have read both mates
-		bam1_t* previously_seen_mate = NULL;
-		if (bam_record->core.flag & BAM_FPAIRED) {
-
-			// try to insert the mate into the collated BAM records
-			// if there was already a record with the same read name, insertion will fail (->second set to false) and
-			// previously_seen_mate->first will point to the mate which was already in the collated BAM records
-			pair<collated_bam_records_t::iterator,bool> find_previously_seen_mate = collated_bam_records.insert(read_name.c_str(), bam_record);
+		stable_sort(cross_shard_mates.begin(), cross_shard_mates.end(), compare_cross_shard_mates_by_position);
+		record_stream_t* stream = new record_stream_t(threads, &chimeric_alignments, contigs.size());
+		streams.push_back(stream);
+		stream->read_through_names = read_through_names;
+		for (vector<cross_shard_mate_t>::iterator mate = cross_shard_mates.begin(); mate != cross_shard_mates.end(); ++mate) {
+			if (stream->fragment_count == stream->fragments.size())
+				process_fragments(*stream, context);
+			collated_mate_t collated_mate = { mate->bam_record, stream->pending_mates.end() };
+			pair<collated_bam_records_t::iterator,bool> find_previously_seen_mate = stream->collated_bam_records.insert_ks(mate->collation_key.c_str(), mate->collation_key.size(), collated_mate);
 			if (!find_previously_seen_mate.second) { // this is the second mate we have seen
-				previously_seen_mate = *find_previously_seen_mate.first;
-				collated_bam_records.erase(find_previously_seen_mate.first);
-			}
-
-		}
-
-		if ((bam_record->core.flag & BAM_FPAIRED) && previously_seen_mate == NULL) { // this is the first mate with the given read name, which we encounter
-			
-			bam_record = bam_init1(); // allocate memory for the next record
-			crash(bam_record == NULL, "failed to allocate memory");
-
-		} else { // single-end data or we have already read the first mate previously
-
-			if (separate_chimeric_bam_file && !is_rna_bam_file) { // this is Chimeric.out.sam => load everything
-
-				mates_t& mates = chimeric_alignments[read_name];
-				add_chimeric_alignment(mates, bam_record);
-				if (previously_seen_mate != NULL)
-					add_chimeric_alignment(mates, previously_seen_mate);
-				no_chimeric_reads = false;
-
-			} else { // this is Aligned.out.bam => load only discordant mates and split reads, and only when there is no Chimeric.out.sam
-
-				// STAR is bad at aligning internal tandem duplications (ITD)
-				// it often does not align them at all or maps the clipped segment to a different chromosome with poor alignment quality
-				// => for every clipped alignment, check if it can be aligned as an ITD
-				bool is_tandem_alignment = false;
-				alignment_t tandem_alignment;
-				if (!clipped_sequence_is_adapter(bam_record, previously_seen_mate) &&
-			           (previously_seen_mate == NULL || get_strand(bam_record) != get_strand(previously_seen_mate)) && // strands must be different, so we can distinguish mate1 from mate2
-			           (is_tandem_duplication(bam_record, assembly, max_itd_length, tandem_alignment) || // is it a tandem duplication that STAR failed to align?
-			            is_tandem_duplication(previously_seen_mate, assembly, max_itd_length, tandem_alignment))) {
-					if (is_rna_bam_file) {
-						mates_t& mates = chimeric_alignments[read_name + "ITD"]; // imitate a multimapping alignment by adding another alignment for the ITD
-						add_chimeric_alignment(mates, bam_record, get_strand(bam_record) == tandem_alignment.strand && !tandem_alignment.supplementary);
-						if (previously_seen_mate != NULL)
-							add_chimeric_alignment(mates, previously_seen_mate, get_strand(previously_seen_mate) == tandem_alignment.strand && !tandem_alignment.supplementary);
-						mates.push_back(tandem_alignment);
-					}
-					is_tandem_alignment = true;
-				}
-
-				// we extract two types of alignments here: chimeric alignments (having an SA tag) and read-through alignments (crossing gene boundaries)
-				bool is_read_through_alignment = false;
-				if (bam_aux_get(bam_record, "SA") != NULL && is_clipped_at_correct_end(bam_record) || // split-read with SA tag
-				    previously_seen_mate != NULL && bam_aux_get(previously_seen_mate, "SA") != NULL && is_clipped_at_correct_end(previously_seen_mate)) { // split-read with SA tag
-					if (!separate_chimeric_bam_file) {
-						mates_t& mates = chimeric_alignments[read_name];
-						add_chimeric_alignment(mates, bam_record);
-						if (previously_seen_mate != NULL)
-							add_chimeric_alignment(mates, previously_seen_mate);
-						no_chimeric_reads = false;
-					}
-				} else if (!is_tandem_alignment) { // could be a read-through alignment
-					is_read_through_alignment = extract_read_through_alignment(chimeric_alignments, read_name, bam_record, previously_seen_mate, gene_annotation_index, separate_chimeric_bam_file);
-
-					// count mapped reads on viral contigs to detect viral infection
-					if (viral_contigs_bool[bam_record->core.tid])
-						for (bam1_t* mate = bam_record; mate != NULL; mate = (mate == previously_seen_mate) ? NULL : previously_seen_mate)
-							if (is_pristine_alignment(mate)) // only count perfectly matching alignments to ignore alignment artifacts
-								mapped_viral_reads_by_contig[mate->core.tid]++;
-				}
-
-				if (!external_duplicate_marking || !(bam_record->core.flag & BAM_FDUP))
-					coverage.add_fragment(bam_record, previously_seen_mate, is_read_through_alignment);
+				bam1_t* previously_seen_mate = find_previously_seen_mate.first->bam_record;
+				stream->collated_bam_records.erase(find_previously_seen_mate.first);
+				bam1_t* bam_record = mate->bam_record;
+				enqueue_fragment(*stream, FRAGMENT_MATES, NULL, 0, bam_record, previously_seen_mate);
+				stream->bam_record_pool.release(bam_record); // the record taken from the pool for the next read is not needed here
 			}
-
-			if (previously_seen_mate != NULL)
-				bam_destroy1(previously_seen_mate);
 		}
+		finish_stream(*stream, context);
 	}
 
-	crash(sam_read1_status < -1, "failed to load alignments");
+	// sum up the counts of all streams
+	bool no_chimeric_reads = true;
+	unsigned int missing_hi_tag = 0;
+	unsigned int malformed_count = 0;
+	for (vector<record_stream_t*>::iterator stream = streams.begin(); stream != streams.end(); ++stream) {
+		mapped_reads += (**stream).mapped_reads;
+		for (unsigned int contig = 0; contig < mapped_viral_reads_by_contig.size(); ++contig)
+			mapped_viral_reads_by_contig[contig] += (**stream).mapped_viral_reads_by_contig[contig];
+		no_chimeric_reads = no_chimeric_reads && (**stream).no_chimeric_reads;
+		missing_hi_tag += (**stream).missing_hi_tag;
+		malformed_count += (**stream).malformed_count;
+		delete *stream;
+	}
 
 	// close BAM file
-	bam_destroy1(bam_record);
+	if (bam_index != NULL)
+		hts_idx_destroy(bam_index);
 	bam_hdr_destroy(bam_header);
 	sam_close(bam_file);
 
@@ -769,6 +1611,79 @@ unsigned int read_chimeric_alignments(const string& bam_file_path, const assembl
 	return chimeric_alignments.size();
 }
 
+unsigned int read_coverage_near_chimeric_alignments(const string& bam_file_path, const assembly_t& assembly, const string& assembly_file_path, const chimeric_alignments_t& chimeric_alignments, const unordered_set<string>& read_through_names, coverage_t& coverage, const contigs_t& contigs, const string& viral_contigs, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file, const bool external_duplicate_marking, const unsigned int max_itd_length, const unsigned int threads) {
+
+	const position_t margin = 1000; // the coverage is queried up to a few hundred bp away from the breakpoints
+
+	// open BAM file
+	samFile* bam_file = sam_open(bam_file_path.c_str(), "rb");
+	crash(bam_file == NULL, "failed to open SAM file");
+	if (bam_file->is_cram)
+		cram_set_option(bam_file->fp.cram, CRAM_OPT_REFERENCE, assembly_file_path.c_str());
+	if (threads > 1)
+		crash(hts_set_threads(bam_file, threads) != 0, "failed to create thread pool");
+	bam_hdr_t* bam_header = sam_hdr_read(bam_file);
+	crash(bam_header == NULL, "failed to read SAM header");
+	hts_idx_t* bam_index = sam_index_load(bam_file, bam_file_path.c_str());
+	crash(bam_index == NULL, "failed to load index of '" + bam_file_path + "' (computing the coverage near chimeric alignments requires a coordinate-sorted and indexed file)");
+
+	// all contigs of the BAM file have been added to <contigs> when the chimeric alignments were read
+	tid_to_contig_t tid_to_contig(bam_header->n_targets);
+	vector<int32_t> contig_to_tid(contigs.size(), -1);
+	for (int target = 0; target < bam_header->n_targets; ++target) {
+		contigs_t::const_iterator contig = contigs.find(removeChr(bam_header->target_name[target]));
+		crash(contig == contigs.end(), "unknown contig: " + bam_header->target_name[target]);
+		tid_to_contig[target] = contig->second;
+		contig_to_tid[contig->second] = target;
+	}
+
+	// read the whole viral contigs, because the 'low_coverage_viral_contigs' filter needs their complete coverage
+	vector<bool> viral_contigs_bool(contigs.size());
+	bam_regions_t bam_regions(bam_header->n_targets);
+	for (contigs_t::const_iterator contig = contigs.begin(); contig != contigs.end(); ++contig) {
+		viral_contigs_bool[contig->second] = is_interesting_contig(contig->first, viral_contigs);
+		if (viral_contigs_bool[contig->second] && contig_to_tid[contig->second] >= 0)
+			bam_regions[contig_to_tid[contig->second]].push_back(make_pair(0, (hts_pos_t) bam_header->target_len[contig_to_tid[contig->second]]));
+	}
+
+	// read the vicinity of all chimeric alignments, since this is where the breakpoints of fusions can be
+	for (chimeric_alignments_t::const_iterator mates = chimeric_alignments.begin(); mates != chimeric_alignments.end(); ++mates)
+		for (mates_t::const_iterator mate = mates->second.begin(); mate != mates->second.end(); ++mate)
+			if ((unsigned int) mate->contig < contig_to_tid.size() && contig_to_tid[mate->contig] >= 0)
+				bam_regions[contig_to_tid[mate->contig]].push_back(make_pair((hts_pos_t) max(0, mate->start - margin), (hts_pos_t) mate->end + margin + 1));
+	merge_bam_regions(bam_regions);
+	unsigned int region_count = 0;
+	for (bam_regions_t::iterator contig = bam_regions.begin(); contig != bam_regions.end(); ++contig)
+		region_count += contig->size();
+
+	// data needed to classify fragments
+	// the fragments are classified like in the first pass to decide whether they count as chimeric, but nothing is stored
+	vector<bool> interesting_tids(contigs.size());
+	classification_context_t context;
+	context.assembly = &assembly;
+	context.gene_annotation_index = &gene_annotation_index;
+	context.tid_to_contig = &tid_to_contig;
+	context.interesting_tids = &interesting_tids;
+	context.viral_contigs_bool = &viral_contigs_bool;
+	context.coverage = &coverage;
+	context.stored_read_through_names = &read_through_names;
+	context.separate_chimeric_bam_file = separate_chimeric_bam_file;
+	context.is_rna_bam_file = true;
+	context.external_duplicate_marking = external_duplicate_marking;
+	context.max_itd_length = max_itd_length;
+
+	record_stream_t stream(threads, NULL, contigs.size());
+	read_records_in_regions(stream, context, bam_file, bam_header, bam_index, bam_regions);
+	finish_stream(stream, context);
+
+	// close BAM file
+	hts_idx_destroy(bam_index);
+	bam_hdr_destroy(bam_header);
+	sam_close(bam_file);
+
+	return region_count;
+}
+
 void assign_strands_from_strandedness(chimeric_alignments_t& chimeric_alignments, const strandedness_t strandedness) {
 	if (strandedness != STRANDEDNESS_NO) {
 		for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); chimeric_alignment != chimeric_alignments.end(); ++chimeric_alignment) {
@@ -787,6 +1702,7 @@ void assign_strands_from_strandedness(chimeric_alignments_t& chimeric_alignments
 }
 
 unsigned int mark_multimappers(chimeric_alignments_t& chimeric_alignments) {
+	chimeric_alignments.sort_by_name(); // group multi-mapping reads
 	unsigned int count = 0;
 	if (!chimeric_alignments.empty())
 		for (chimeric_alignments_t::iterator chimeric_alignment = chimeric_alignments.begin(); next(chimeric_alignment) != chimeric_alignments.end(); ++chimeric_alignment)
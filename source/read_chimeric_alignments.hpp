@@ -2,13 +2,32 @@
 #define READ_CHIMERIC_ALIGNMENTS_H 1
 
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include "common.hpp"
 #include "read_stats.hpp"
 
 using namespace std;
 
-unsigned int read_chimeric_alignments(const string& bam_file_path, const assembly_t& assembly, const string& assembly_file_path, chimeric_alignments_t& chimeric_alignments, unsigned long int& mapped_reads, vector<unsigned long int>& mapped_viral_reads_by_contig, coverage_t& coverage, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const string& viral_contigs, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file, const bool is_rna_bam_file, const bool external_duplicate_marking, const unsigned int max_itd_length);
+// regions to which reading of alignments is restricted (zero-based, end inclusive)
+struct region_t {
+	contig_t contig;
+	position_t start;
+	position_t end;
+};
+typedef vector<region_t> regions_t;
+
+// load regions from a BED file or from a file listing genes or ranges (e.g., a list of known fusions)
+unsigned int load_regions(const string& regions_file_path, const contigs_t& contigs, const unordered_map<string,gene_t>& genes, regions_t& regions);
+
+// when <read_through_names> is given, the coverage is not computed, but the names of the stored read-through alignments are collected,
+// such that the coverage can be computed later using read_coverage_near_chimeric_alignments()
+unsigned int read_chimeric_alignments(const string& bam_file_path, const assembly_t& assembly, const string& assembly_file_path, chimeric_alignments_t& chimeric_alignments, unsigned long int& mapped_reads, vector<unsigned long int>& mapped_viral_reads_by_contig, coverage_t& coverage, contigs_t& contigs, vector<string>& original_contig_names, const string& interesting_contigs, const string& viral_contigs, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file, const bool is_rna_bam_file, const bool external_duplicate_marking, const unsigned int max_itd_length, const unsigned int threads, const regions_t& regions, const bool sharded, unordered_set<string>* read_through_names);
+
+// compute the coverage only in the vicinity of the chimeric alignments and on viral contigs by reading these regions from the indexed BAM file
+// returns the number of regions
+unsigned int read_coverage_near_chimeric_alignments(const string& bam_file_path, const assembly_t& assembly, const string& assembly_file_path, const chimeric_alignments_t& chimeric_alignments, const unordered_set<string>& read_through_names, coverage_t& coverage, const contigs_t& contigs, const string& viral_contigs, const gene_annotation_index_t& gene_annotation_index, const bool separate_chimeric_bam_file, const bool external_duplicate_marking, const unsigned int max_itd_length, const unsigned int threads);
 
 void assign_strands_from_strandedness(chimeric_alignments_t& chimeric_alignments, const strandedness_t strandedness);
 
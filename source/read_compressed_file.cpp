@@ -1,5 +1,9 @@
 #include <string>
 #include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "bgzf.h"
 #include "sam.h"
 #include "common.hpp"
@@ -44,6 +48,47 @@ autodecompress_file_t::autodecompress_file_t(const string& file_path) {
 	}
 }
 
+void decompress_file(const string& file_path, string& content) {
+
+	BGZF* compressed_file = bgzf_open(file_path.c_str(), "rb");
+	crash(compressed_file == NULL, "failed to open/decompress file: " + file_path);
+
+	// read data from file in blocks and append them to the content
+	const unsigned int buffer_size = 1024*1024;
+	content.clear();
+	ssize_t bytes_read;
+	do {
+		content.resize(content.size() + buffer_size);
+		bytes_read = bgzf_read(compressed_file, &content[content.size() - buffer_size], buffer_size);
+		crash(bytes_read < 0, "failed to decompress file: " + file_path);
+		content.resize(content.size() - buffer_size + bytes_read);
+	} while (bytes_read == (ssize_t) buffer_size);
+
+	bgzf_close(compressed_file);
+}
+
+file_content_t::file_content_t(const string& file_path): mapped_file(NULL), mapped_file_size(0) {
+	if (file_path.length() >= 3 && file_path.substr(file_path.length() - 3) == ".gz") {
+		decompress_file(file_path, decompressed_file);
+	} else {
+		int file_descriptor = open(file_path.c_str(), O_RDONLY);
+		crash(file_descriptor < 0, "failed to open file: " + file_path);
+		struct stat file_status;
+		crash(fstat(file_descriptor, &file_status) != 0, "failed to open file: " + file_path);
+		if (file_status.st_size > 0) { // empty files cannot be mapped
+			mapped_file = mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+			crash(mapped_file == MAP_FAILED, "failed to map file into memory: " + file_path);
+			mapped_file_size = file_status.st_size;
+		}
+		close(file_descriptor);
+	}
+}
+
+file_content_t::~file_content_t() {
+	if (mapped_file != NULL)
+		munmap(mapped_file, mapped_file_size);
+}
+
 bool autodecompress_file_t::getline(string& line) {
 	if (compressed) {
 		if (!std::getline(decompressed_file_content, line))
@@ -7,6 +7,25 @@
 
 using namespace std;
 
+// load the complete content of a (possibly compressed) file into memory
+void decompress_file(const string& file_path, string& content);
+
+// the complete content of a file in memory for parsing it in parallel
+// uncompressed files are mapped into memory, compressed files are decompressed
+class file_content_t {
+	public:
+		file_content_t(const string& file_path);
+		~file_content_t();
+		const char* data() const { return (mapped_file != NULL) ? (const char*) mapped_file : decompressed_file.data(); };
+		size_t size() const { return (mapped_file != NULL) ? mapped_file_size : decompressed_file.size(); };
+	private:
+		file_content_t(const file_content_t&);
+		file_content_t& operator=(const file_content_t&);
+		void* mapped_file;
+		size_t mapped_file_size;
+		string decompressed_file;
+};
+
 class autodecompress_file_t {
 	public:
 		autodecompress_file_t(const string& file_path);
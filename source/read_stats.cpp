@@ -1,4 +1,3 @@
-#include <climits>
 #include <cmath>
 #include <iostream>
 #include <list>
@@ -91,7 +90,7 @@ bool estimate_fragment_length(const chimeric_alignments_t& chimeric_alignments,
 	return true;
 }
 
-strandedness_t detect_strandedness(const chimeric_alignments_t& chimeric_alignments, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index) {
+strandedness_t detect_strandedness(const chimeric_alignments_t& chimeric_alignments, const gene_annotation_index_t& gene_annotation_index) {
 
 	const unsigned int sample_size = 100; // examine at least this many reads to determine strandedness
 	const float threshold = 0.95; // fraction of reads which must support strandedness to be convinced
@@ -115,7 +114,7 @@ strandedness_t detect_strandedness(const chimeric_alignments_t& chimeric_alignme
 					// use only reads which are spliced, because this is a sure indication that the read originates from the gene
 					direction_t direction = (chimeric_alignment->second[SPLIT_READ].strand == FORWARD) ? UPSTREAM : DOWNSTREAM;
 					position_t position = (chimeric_alignment->second[SPLIT_READ].strand == FORWARD) ? chimeric_alignment->second[SPLIT_READ].start : chimeric_alignment->second[SPLIT_READ].end;
-					if (is_breakpoint_spliced(*genes.begin(), direction, position, exon_annotation_index)) {
+					if (is_breakpoint_spliced(*genes.begin(), direction, position)) {
 
 						// check if alignment matches strand of annotated gene
 						if (chimeric_alignment->second[SPLIT_READ].first_in_pair && chimeric_alignment->second[SPLIT_READ].strand == (**genes.begin()).strand ||
@@ -143,6 +142,7 @@ strandedness_t detect_strandedness(const chimeric_alignments_t& chimeric_alignme
 }
 
 // initialize data structure to compute coverage for windows of size <COVERAGE_RESOLUTION>
+// no memory is allocated for the windows until reads are added
 void coverage_t::resize(const contigs_t& contigs, const assembly_t& assembly) {
 	fragment_starts.resize(contigs.size());
 	fragment_ends.resize(contigs.size());
@@ -158,7 +158,7 @@ void coverage_t::resize(const contigs_t& contigs, const assembly_t& assembly) {
 }
 
 // add alignment to coverage
-void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric) {
+void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric, fragment_boundaries_t* deferred_boundaries) {
 
 	// fake paired-end data, if single-end data given, to avoid NULL pointer exceptions
 	if (mate2 == NULL)
@@ -182,11 +182,22 @@ void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric) {
 	}
 
 	// store start of fragment
+	if (deferred_boundaries != NULL) {
+		deferred_boundaries->valid = !is_chimeric;
+		if (!(mate1->core.flag & BAM_FREVERSE) || !(mate1->core.flag & BAM_FPAIRED)) {
+			deferred_boundaries->start_contig = mate1->core.tid;
+			deferred_boundaries->start = mate1->core.pos;
+		} else {
+			deferred_boundaries->start_contig = mate2->core.tid;
+			deferred_boundaries->start = mate2->core.pos;
+		}
+		is_chimeric = true;
+	}
 	if (!is_chimeric) { // the 'no_coverage' filter should only consider non-chimeric reads
 		if (!(mate1->core.flag & BAM_FREVERSE) || !(mate1->core.flag & BAM_FPAIRED))
-			fragment_starts[mate1->core.tid][mate1->core.pos/COVERAGE_RESOLUTION] = true;
+			fragment_starts[mate1->core.tid].set(mate1->core.pos/COVERAGE_RESOLUTION, true);
 		else
-			fragment_starts[mate2->core.tid][mate2->core.pos/COVERAGE_RESOLUTION] = true;
+			fragment_starts[mate2->core.tid].set(mate2->core.pos/COVERAGE_RESOLUTION, true);
 	}
 
 	// compute coverage from CIGAR string
@@ -245,9 +256,8 @@ void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric) {
 		// increase coverage counter of windows that CIGAR element overlaps with
 		if (bam_cigar_type(bam_cigar_op(cigar_op)) & 1/*consume query*/) {
 			while (window <= position/COVERAGE_RESOLUTION) {
-				if (coverage[contig][window] < USHRT_MAX)
-					if (position - window * COVERAGE_RESOLUTION >= COVERAGE_RESOLUTION/2) // read must overlap at least half of the window
-						coverage[contig][window]++;
+				if (position - window * COVERAGE_RESOLUTION >= COVERAGE_RESOLUTION/2) // read must overlap at least half of the window
+					coverage[contig].increment(window);
 				++window;
 			}
 		} else {
@@ -257,11 +267,28 @@ void coverage_t::add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric) {
 	}
 
 	// store end of fragment
+	if (deferred_boundaries != NULL) {
+		if ((mate1->core.flag & BAM_FREVERSE) || !(mate1->core.flag & BAM_FPAIRED)) {
+			deferred_boundaries->end_contig = mate1->core.tid;
+			deferred_boundaries->end = position1 - 1;
+		} else {
+			deferred_boundaries->end_contig = mate2->core.tid;
+			deferred_boundaries->end = position2 - 1;
+		}
+	}
 	if (!is_chimeric) { // the 'no_coverage' filter should only consider non-chimeric reads
 		if ((mate1->core.flag & BAM_FREVERSE) || !(mate1->core.flag & BAM_FPAIRED))
-			fragment_ends[mate1->core.tid][(position1-1)/COVERAGE_RESOLUTION] = true;
+			fragment_ends[mate1->core.tid].set((position1-1)/COVERAGE_RESOLUTION, true);
 		else
-			fragment_ends[mate2->core.tid][(position2-1)/COVERAGE_RESOLUTION] = true;
+			fragment_ends[mate2->core.tid].set((position2-1)/COVERAGE_RESOLUTION, true);
+	}
+}
+
+// add the boundaries of a fragment, which was added via add_fragment() with deferred boundaries and turned out to be non-chimeric
+void coverage_t::add_fragment_boundaries(const fragment_boundaries_t& boundaries) {
+	if (boundaries.valid) {
+		fragment_starts[boundaries.start_contig].set(boundaries.start/COVERAGE_RESOLUTION, true);
+		fragment_ends[boundaries.end_contig].set(boundaries.end/COVERAGE_RESOLUTION, true);
 	}
 }
 
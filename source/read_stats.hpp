@@ -1,6 +1,8 @@
 #ifndef READ_STATS_H
 #define READ_STATS_H 1
 
+#include <atomic>
+#include <limits>
 #include <vector>
 #include "common.hpp"
 #include "annotation.hpp"
@@ -9,18 +11,115 @@ using namespace std;
 
 bool estimate_fragment_length(const chimeric_alignments_t& chimeric_alignments, float& mate_gap_mean, float& mate_gap_stddev, float& read_length_mean, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index);
 
-strandedness_t detect_strandedness(const chimeric_alignments_t& chimeric_alignments, const gene_annotation_index_t& gene_annotation_index, const exon_annotation_index_t& exon_annotation_index);
+strandedness_t detect_strandedness(const chimeric_alignments_t& chimeric_alignments, const gene_annotation_index_t& gene_annotation_index);
 
 const int COVERAGE_RESOLUTION = 20; // at what resolution in bp to calculate the coverage
+const size_t COVERAGE_BLOCK_WINDOWS = 1000000 / COVERAGE_RESOLUTION; // windows are allocated in blocks of 1 Mb
+
+// stores a value for every window of a contig
+// the memory for a block of windows is only allocated when a value is first written to the block,
+// such that regions without reads (and contigs without reads) cost next to nothing
+// the values (and the allocation of blocks) are atomic, such that multiple threads can write to the windows concurrently
+template <class T> class coverage_windows_t {
+	public:
+		coverage_windows_t(): window_count(0), block_count(0), blocks(NULL) {};
+		coverage_windows_t(const coverage_windows_t& other): window_count(0), block_count(0), blocks(NULL) { *this = other; };
+		~coverage_windows_t() { clear(); };
+		coverage_windows_t& operator=(const coverage_windows_t& other) {
+			if (this != &other) {
+				clear();
+				resize(other.window_count);
+				for (size_t block = 0; block < block_count; ++block) {
+					const atomic<T>* other_windows = other.blocks[block].load(memory_order_acquire);
+					if (other_windows != NULL) {
+						atomic<T>* windows = get_block(block);
+						for (size_t window = 0; window < block_size(block); ++window)
+							windows[window].store(other_windows[window].load(memory_order_relaxed), memory_order_relaxed);
+					}
+				}
+			}
+			return *this;
+		};
+		// existing values are discarded, when the number of windows changes
+		void resize(const size_t windows) {
+			if (windows == window_count)
+				return;
+			clear();
+			window_count = windows;
+			block_count = (windows + COVERAGE_BLOCK_WINDOWS - 1) / COVERAGE_BLOCK_WINDOWS;
+			blocks = new atomic<atomic<T>*>[block_count];
+			for (size_t block = 0; block < block_count; ++block)
+				blocks[block].store(NULL, memory_order_relaxed);
+		};
+		void clear() {
+			for (size_t block = 0; block < block_count; ++block)
+				delete[] blocks[block].load(memory_order_relaxed);
+			delete[] blocks;
+			blocks = NULL;
+			window_count = 0;
+			block_count = 0;
+		};
+		size_t size() const { return window_count; };
+		bool empty() const { return window_count == 0; };
+		// windows in blocks which have not been written yet are zero
+		T operator[](const size_t window) const {
+			const atomic<T>* windows = blocks[window / COVERAGE_BLOCK_WINDOWS].load(memory_order_acquire);
+			return (windows == NULL) ? T() : windows[window % COVERAGE_BLOCK_WINDOWS].load(memory_order_relaxed);
+		};
+		void set(const size_t window, const T value) {
+			get_block(window / COVERAGE_BLOCK_WINDOWS)[window % COVERAGE_BLOCK_WINDOWS].store(value, memory_order_relaxed);
+		};
+		// increase the value by one, unless the maximum value is reached
+		void increment(const size_t window) {
+			atomic<T>& value = get_block(window / COVERAGE_BLOCK_WINDOWS)[window % COVERAGE_BLOCK_WINDOWS];
+			T current_value = value.load(memory_order_relaxed);
+			while (current_value < numeric_limits<T>::max() && !value.compare_exchange_weak(current_value, (T) (current_value + 1), memory_order_relaxed));
+		};
+	private:
+		size_t block_size(const size_t block) const {
+			return min(COVERAGE_BLOCK_WINDOWS, window_count - block * COVERAGE_BLOCK_WINDOWS);
+		};
+		// allocates the block, if necessary
+		atomic<T>* get_block(const size_t block) {
+			atomic<T>* windows = blocks[block].load(memory_order_acquire);
+			if (windows == NULL) {
+				// when multiple threads allocate the same block at the same time, the first one wins and the others discard their blocks
+				atomic<T>* allocated_windows = new atomic<T>[block_size(block)]();
+				if (blocks[block].compare_exchange_strong(windows, allocated_windows, memory_order_acq_rel))
+					windows = allocated_windows;
+				else
+					delete[] allocated_windows;
+			}
+			return windows;
+		};
+		size_t window_count;
+		size_t block_count;
+		atomic<atomic<T>*>* blocks;
+};
+
+// start and end of a fragment, whose contribution to the 'no_coverage' filter can only be decided later,
+// because it is not yet known whether the fragment counts as chimeric
+struct fragment_boundaries_t {
+	fragment_boundaries_t(): valid(false) {};
+	bool valid; // false, if the fragment is chimeric anyway (or was not added to the coverage at all)
+	contig_t start_contig;
+	position_t start;
+	contig_t end_contig;
+	position_t end;
+};
+
 // for each contig store for every window of <COVERAGE_RESOLUTION> bp whether a read starts/ends here
 // this information is needed by the 'no_coverage' filter
 class coverage_t {
 	public:
-		vector< vector<bool> > fragment_starts; // for each window, store if a fragment starts here
-		vector< vector<bool> > fragment_ends; // for each window, store if a fragment ends here
-		vector< vector<unsigned short int> > coverage; // for each window, store the coverage
+		vector< coverage_windows_t<bool> > fragment_starts; // for each window, store if a fragment starts here
+		vector< coverage_windows_t<bool> > fragment_ends; // for each window, store if a fragment ends here
+		vector< coverage_windows_t<unsigned short int> > coverage; // for each window, store the coverage
 		void resize(const contigs_t& contigs, const assembly_t& assembly);
-		void add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric);
+		// when <deferred_boundaries> is given, the fragment is treated as chimeric and its boundaries are returned instead,
+		// such that they can be added via add_fragment_boundaries(), if it turns out to be non-chimeric
+		void add_fragment(bam1_t* mate1, bam1_t* mate2, bool is_chimeric, fragment_boundaries_t* deferred_boundaries = NULL);
+		void add_fragment_boundaries(const fragment_boundaries_t& boundaries);
 		bool fragment_starts_here(const contig_t contig, const position_t start, const position_t end) const;
 		bool fragment_ends_here(const contig_t contig, const position_t start, const position_t end) const;
 		int get_coverage(const contig_t contig, const position_t position, const direction_t direction) const;
@@ -34,13 +34,11 @@ unsigned int count_supporting_reads(fusion_t& fusion, unordered_map<gene_t,unsig
 
 		// count intra-exonic breakpoints only if the exons are not too big
 		// otherwise it's probably an libprep-mediated artifact caused by fragments sticking together due to hybridization
-		exon_set_t exons;
-		get_annotation_by_coordinate(fusion.contig1, fusion.breakpoint1, fusion.breakpoint1, exons, exon_annotation_index);
+		exon_span_t exons = get_annotation_at_position(fusion.contig1, fusion.breakpoint1, exon_annotation_index);
 		for (auto exon = exons.begin(); exon != exons.end(); ++exon)
 			if ((**exon).end + 1 - (**exon).start > max_exon_size)
 				return 0;
-		exons.clear();
-		get_annotation_by_coordinate(fusion.contig2, fusion.breakpoint2, fusion.breakpoint2, exons, exon_annotation_index);
+		exons = get_annotation_at_position(fusion.contig2, fusion.breakpoint2, exon_annotation_index);
 		for (auto exon = exons.begin(); exon != exons.end(); ++exon)
 			if ((**exon).end + 1 - (**exon).start > max_exon_size)
 				return 0;